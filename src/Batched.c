@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <omp.h>
+#include "utils.h"
+#include "transpose.h"
+
+int main(int argc, char **argv) {
+    bool check, verbose, conj;
+    DType dt;
+
+    parse_dtype_args(&argc, argv, &dt, &conj);
+    bool use_ptrs = take_option(&argc, argv, "--ptrs", false) != NULL;
+    if (argc < 3 || argc >= 6) {
+        printf("Usage: %s <matrix_dim> <batch_count> [<check_correctness>] [<verbose>] [--dtype <type>] [--conj] [--ptrs]\n", argv[0]);
+        return 1;
+    }
+    int N = atoi(argv[1]);
+    int batch = atoi(argv[2]);
+    check = argc >= 4 && strcmp(argv[3], "check") == 0;
+    verbose = argc >= 5 && strcmp(argv[4], "verbose") == 0;
+    if (N <= 0 || batch <= 0) {
+        printf("Error: matrix_dim and batch_count must be positive integers\n");
+        return 1;
+    }
+    srand(time(NULL));
+
+    // Allocate the batch, either as one strided buffer or as separately allocated matrices
+    size_t esz = dtype_size(dt);
+    size_t matrix_bytes = (size_t) N * N * esz;
+    char **src = (char **) malloc(batch * sizeof(char *));
+    char **dst = (char **) malloc(batch * sizeof(char *));
+    char *src_base = NULL, *dst_base = NULL;
+    if (use_ptrs) {
+        for (int k = 0; k < batch; k++) {
+            src[k] = (char *) malloc(matrix_bytes);
+            dst[k] = (char *) malloc(matrix_bytes);
+        }
+    } else {
+        src_base = (char *) malloc(matrix_bytes * batch);
+        dst_base = (char *) malloc(matrix_bytes * batch);
+        for (int k = 0; k < batch; k++) {
+            src[k] = src_base + k * matrix_bytes;
+            dst[k] = dst_base + k * matrix_bytes;
+        }
+    }
+    for (int k = 0; k < batch; k++) {
+        for (size_t e = 0; e < (size_t) N * N; e++) {
+            dtype_set_rand(dt, src[k] + e * esz);
+        }
+    }
+
+    TransposePlan *plan = transpose_plan_batched(N, batch, 0, dt, 0, conj ? TRANSPOSE_CONJ : 0);
+    if (plan == NULL) {
+        printf("Error: cannot plan the batched transpose\n");
+        return 1;
+    }
+    double start, end;
+    start = omp_get_wtime();
+    if (use_ptrs) {
+        transpose_execute_batch_ptrs(plan, (const void *const *) src, (void *const *) dst);
+    } else {
+        transpose_execute(plan, src_base, dst_base);
+    }
+    end = omp_get_wtime();
+
+    if (verbose) {
+        printf("Time taken for batched transposition: %.9fs\n", end - start);
+        for (int k = 0; k < batch; k++) {
+            printf("- Input matrix %d -\n", k);
+            print_matrix(N, dt, &src[k]);
+            printf("- Transposed matrix %d -\n", k);
+            print_matrix(N, dt, &dst[k]);
+        }
+    } else {
+        printf("threads: %d, batch: %d, transpose_time: %f, matrices_per_second: %f\n",
+               omp_get_max_threads(), batch, end - start, batch / (end - start));
+    }
+    if (check) {
+        bool correct = true;
+        for (int k = 0; k < batch && correct; k++) {
+            for (int i = 0; i < N && correct; i++) {
+                for (int j = 0; j < N; j++) {
+                    if (!dtype_equal(dt, src[k] + ((size_t) i * N + j) * esz, dst[k] + ((size_t) j * N + i) * esz, conj)) {
+                        printf("Error: matrix %d is not transposed correctly at [%d][%d]\n", k, i, j);
+                        correct = false;
+                        break;
+                    }
+                }
+            }
+        }
+        if (correct) {
+            printf("Matrix transpose is correct\n");
+        }
+    }
+    transpose_plan_destroy(plan);
+    if (use_ptrs) {
+        for (int k = 0; k < batch; k++) {
+            free(src[k]);
+            free(dst[k]);
+        }
+    }
+    free(src_base);
+    free(dst_base);
+    free(src);
+    free(dst);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <omp.h>
+#include "utils.h"
+#include "kernels.h"
+#include "transpose.h"
+
+// Random values in [-range, range), spanning many binades so that rounding is exercised
+void fill_signed_matrix(int N, float range, float *mat) {
+    for (size_t e = 0; e < (size_t) N * N; e++) {
+        float sign = (rand() & 1) ? 1.0f : -1.0f;
+        mat[e] = sign * range * ldexpf(rand() / (float) RAND_MAX, -(rand() % 16));
+    }
+}
+
+// int8 scales mapping the largest magnitude to 127: one for the matrix, or one per row of the
+// transposed matrix, that is per column of `mat`
+void compute_scales(int N, const float *mat, bool per_row, float *scales) {
+    int count = per_row ? N : 1;
+    for (int j = 0; j < count; j++) {
+        scales[j] = 0;
+    }
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            float *s = &scales[per_row ? j : 0];
+            float v = fabsf(mat[(size_t) i * N + j]);
+            *s = v > *s ? v : *s;
+        }
+    }
+    for (int j = 0; j < count; j++) {
+        scales[j] = scales[j] > 0 ? scales[j] / 127 : 1;
+    }
+}
+
+// Convert one row of n elements of the transposed float matrix
+void convert_row(DType to, RoundMode mode, const float *src, char *dst, int n, float scale) {
+    int c = 0;
+    for (; c + 8 <= n; c += 8) {
+        switch (to) {
+            case DTYPE_BF16: convert_row_bf16(src + c, (uint16_t *) dst + c, 8, scale, mode); break;
+            case DTYPE_HALF: convert_row_half(src + c, (uint16_t *) dst + c, 8, scale, mode); break;
+            default: convert_row_int8(src + c, (int8_t *) dst + c, 8, scale, mode); break;
+        }
+    }
+    switch (to) {
+        case DTYPE_BF16: convert_row_bf16(src + c, (uint16_t *) dst + c, n - c, scale, mode); break;
+        case DTYPE_HALF: convert_row_half(src + c, (uint16_t *) dst + c, n - c, scale, mode); break;
+        default: convert_row_int8(src + c, (int8_t *) dst + c, n - c, scale, mode); break;
+    }
+}
+
+// Compare every converted element with the scalar conversion of the input element
+bool check_conversion(int N, DType to, RoundMode mode, const float *mat, const char *mat_t,
+                      const float *scales, bool per_row) {
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            float x = mat[(size_t) i * N + j];
+            size_t t = (size_t) j * N + i;
+            bool ok;
+            switch (to) {
+                case DTYPE_BF16: ok = ((const uint16_t *) mat_t)[t] == float_to_bf16_round(x, mode); break;
+                case DTYPE_HALF: ok = ((const uint16_t *) mat_t)[t] == float_to_half_round(x, mode); break;
+                default: ok = ((const int8_t *) mat_t)[t] == float_to_int8_round(x, scales[per_row ? j : 0], mode); break;
+            }
+            if (!ok) {
+                printf("Error: mat[%d][%d] = %.9g is not converted correctly\n", i, j, x);
+                return false;
+            }
+        }
+    }
+    printf("Matrix transpose is correct\n");
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bool check, verbose, conj;
+    int N;
+    DType dt;
+
+    parse_dtype_args(&argc, argv, &dt, &conj);
+    const char *to_arg = take_option(&argc, argv, "--to", true);
+    const char *round_arg = take_option(&argc, argv, "--round", true);
+    const char *scale_arg = take_option(&argc, argv, "--scale", true);
+    parse_args(argc, argv, &N, &check, &verbose);
+    DType to = parse_dtype(to_arg != NULL ? to_arg : "bf16");
+    if (dt != DTYPE_FLOAT || (to != DTYPE_BF16 && to != DTYPE_HALF && to != DTYPE_INT8)) {
+        printf("Error: only float to bf16, half and int8 conversions are supported\n");
+        return 1;
+    }
+    RoundMode mode = round_arg != NULL && strcmp(round_arg, "zero") == 0 ? ROUND_TOWARD_ZERO : ROUND_NEAREST_EVEN;
+    bool per_row = scale_arg != NULL && strcmp(scale_arg, "row") == 0;
+    srand(time(NULL));
+
+    size_t to_size = dtype_size(to);
+    float *mat = (float *) malloc((size_t) N * N * sizeof(float));
+    float *tmp = (float *) malloc((size_t) N * N * sizeof(float));
+    char *mat_t = (char *) malloc((size_t) N * N * to_size);
+    float *scales = (float *) malloc(N * sizeof(float));
+    fill_signed_matrix(N, 1000.0f, mat);
+    if (to == DTYPE_INT8) {
+        compute_scales(N, mat, per_row, scales);
+    }
+
+    unsigned flags = (mode == ROUND_TOWARD_ZERO ? TRANSPOSE_ROUND_ZERO : 0) | (per_row ? TRANSPOSE_SCALE_PER_ROW : 0);
+    TransposePlan *plan = transpose_plan_convert(N, N, 0, 0, to, scales, 0, flags);
+    TransposePlan *transpose_plan = transpose_plan_create(N, N, 0, 0, DTYPE_FLOAT, 0, 0, 0);
+    double start, end;
+    // Touch the outputs so that neither timing includes page faults
+    memset(tmp, 0, (size_t) N * N * sizeof(float));
+    memset(mat_t, 0, (size_t) N * N * to_size);
+
+    // Two sweeps: transpose the float matrix, then convert it
+    start = omp_get_wtime();
+    transpose_execute(transpose_plan, mat, tmp);
+    #pragma omp parallel for
+    for (int j = 0; j < N; j++) {
+        convert_row(to, mode, tmp + (size_t) j * N, mat_t + (size_t) j * N * to_size, N, scales[per_row ? j : 0]);
+    }
+    end = omp_get_wtime();
+    double two_pass_time = end - start;
+
+    // One fused sweep
+    start = omp_get_wtime();
+    transpose_execute(plan, mat, mat_t);
+    end = omp_get_wtime();
+
+    if (verbose) {
+        printf("Time taken for float to %s transposition: %.9fs fused, %.9fs in two passes\n",
+               dtype_name(to), end - start, two_pass_time);
+    } else {
+        printf("threads: %d, transpose_time: %f, two_pass_time: %f\n", omp_get_max_threads(), end - start, two_pass_time);
+    }
+    if (check) {
+        check_conversion(N, to, mode, mat, mat_t, scales, per_row);
+    }
+    transpose_plan_destroy(plan);
+    transpose_plan_destroy(transpose_plan);
+    return 0;
+}
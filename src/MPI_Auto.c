@@ -0,0 +1,552 @@
+#include <math.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+#include "utils.h"
+#include "mpi_utils.h"
+
+// Blocks whose source and transpose fit together in this many bytes are transposed from cache
+#define MODEL_CACHE_BYTES (1 << 20)
+// Size of the matrices used to calibrate the kernels out of cache and the memory bandwidth
+#define MODEL_LARGE_BYTES (32 << 20)
+// Element sizes of the dtypes: 1, 2, 4, 8 and 16 bytes
+#define MODEL_ESZ 5
+// Numbers of processes whose collectives are kept in the model
+#define MODEL_SIZES 32
+// Bytes moved by the root in the large collectives of the calibration
+#define MODEL_COLLECTIVE_BYTES (8 << 20)
+
+// Variants benchmarked by main.pbs. tile is the local tile of the blocked strategy: 0 for the
+// untiled transpose of MPI_Blocks, the inner block size of MPI_Blocks_32/64/128 otherwise.
+typedef struct {
+  const char *name;
+  TransposeMPIStrategy strategy;
+  int tile;
+} Variant;
+
+static const Variant variants[] = {
+  {"broadcast", TRANSPOSE_MPI_BROADCAST, 0},
+  {"scatter", TRANSPOSE_MPI_SCATTER, 0},
+  {"blocks", TRANSPOSE_MPI_BLOCKS, 0},
+  {"blocks32", TRANSPOSE_MPI_BLOCKS, 32},
+  {"blocks64", TRANSPOSE_MPI_BLOCKS, 64},
+  {"blocks128", TRANSPOSE_MPI_BLOCKS, 128},
+};
+#define VARIANTS (int) (sizeof(variants) / sizeof(variants[0]))
+#define TILES 4
+static const int model_tiles[TILES] = {0, 32, 64, 128};
+
+// Collectives of the strategies, measured for a number of processes: a collective moving
+// `bytes` bytes from or to the root takes latency + bytes / bw
+typedef enum { COLLECTIVE_BCAST, COLLECTIVE_SCATTER, COLLECTIVE_GATHER, COLLECTIVES } Collective;
+static const char *const collective_names[COLLECTIVES] = {"bcast", "scatter", "gather"};
+
+typedef struct {
+  int size;
+  double latency[COLLECTIVES], bw[COLLECTIVES];
+} CollectiveModel;
+
+// Calibrated performance of the machine. Bandwidths are in bytes per second, the copies
+// through a datatype and the kernels are measured per element size.
+typedef struct {
+  bool has_memory, has_network;
+  // Copy between two buffers, first write to freshly allocated memory (page faults), latency
+  // and bandwidth of a message between two ranks
+  double memory_bw, fault_bw, latency, network_bw;
+  CollectiveModel collectives[MODEL_SIZES];
+  int num_collectives;
+  bool has_elem[MODEL_ESZ];
+  // Copy of contiguous rows into the columns of a matrix (receive datatype of the broadcast and
+  // scatter strategies) and out of a block of a matrix (datatype of the blocked strategy)
+  double column_bw[MODEL_ESZ], subarray_bw[MODEL_ESZ];
+  // Single-thread transpose for each tile of model_tiles, in and out of cache
+  double kernel_small_bw[MODEL_ESZ][TILES], kernel_large_bw[MODEL_ESZ][TILES];
+} Model;
+
+static int esz_index(size_t esz) {
+  int k = 0;
+  while (((size_t) 1 << k) < esz) {
+    k++;
+  }
+  return k;
+}
+
+// Collectives measured for `size` processes, NULL if they have not been
+static const CollectiveModel *find_collectives(const Model *m, int size) {
+  for (int k = 0; k < m->num_collectives; k++) {
+    if (m->collectives[k].size == size) {
+      return &m->collectives[k];
+    }
+  }
+  return NULL;
+}
+
+// Entry of the collectives of `size` processes, replacing the last one when the model is full
+static CollectiveModel *add_collectives(Model *m, int size) {
+  for (int k = 0; k < m->num_collectives; k++) {
+    if (m->collectives[k].size == size) {
+      return &m->collectives[k];
+    }
+  }
+  CollectiveModel *c = &m->collectives[m->num_collectives < MODEL_SIZES ? m->num_collectives++ : MODEL_SIZES - 1];
+  c->size = size;
+  return c;
+}
+
+static int tile_index(int tile) {
+  for (int k = 0; k < TILES; k++) {
+    if (model_tiles[k] == tile) {
+      return k;
+    }
+  }
+  return 0;
+}
+
+// Load the model saved in `path`. Missing files or lines leave the corresponding parts of the
+// model uncalibrated.
+static void load_model(const char *path, Model *m) {
+  memset(m, 0, sizeof(Model));
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    size_t esz;
+    int tile, size;
+    double a, b, c;
+    double v[2 * COLLECTIVES];
+    if (sscanf(line, "memory %lf %lf", &a, &b) == 2) {
+      m->memory_bw = a;
+      m->fault_bw = b;
+      m->has_memory = true;
+    } else if (sscanf(line, "network %lf %lf", &a, &b) == 2) {
+      m->latency = a;
+      m->network_bw = b;
+      m->has_network = true;
+    } else if (sscanf(line, "collectives %d %lf %lf %lf %lf %lf %lf", &size, &v[0], &v[1], &v[2], &v[3], &v[4],
+                      &v[5]) == 1 + 2 * COLLECTIVES) {
+      CollectiveModel *coll = add_collectives(m, size);
+      for (int k = 0; k < COLLECTIVES; k++) {
+        coll->latency[k] = v[2 * k];
+        coll->bw[k] = v[2 * k + 1];
+      }
+    } else if (sscanf(line, "datatypes %zu %lf %lf", &esz, &a, &b) == 3 && esz_index(esz) < MODEL_ESZ) {
+      m->column_bw[esz_index(esz)] = a;
+      m->subarray_bw[esz_index(esz)] = b;
+      m->has_elem[esz_index(esz)] = true;
+    } else if (sscanf(line, "kernel %zu %d %lf %lf", &esz, &tile, &b, &c) == 4 && esz_index(esz) < MODEL_ESZ) {
+      m->kernel_small_bw[esz_index(esz)][tile_index(tile)] = b;
+      m->kernel_large_bw[esz_index(esz)][tile_index(tile)] = c;
+    }
+  }
+  fclose(f);
+}
+
+static void save_model(const char *path, const Model *m) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    printf("Warning: cannot write the model to %s\n", path);
+    return;
+  }
+  fprintf(f, "# Performance model of the MPI transposes, bandwidths in bytes/s and latency in s\n");
+  fprintf(f, "# network <point-to-point latency> <point-to-point bw>\n");
+  fprintf(f, "# collectives <processes>");
+  for (int c = 0; c < COLLECTIVES; c++) {
+    fprintf(f, " <%s latency> <%s bw>", collective_names[c], collective_names[c]);
+  }
+  fprintf(f, "\n");
+  if (m->has_memory) {
+    fprintf(f, "memory %g %g\n", m->memory_bw, m->fault_bw);
+  }
+  if (m->has_network) {
+    fprintf(f, "network %g %g\n", m->latency, m->network_bw);
+  }
+  for (int k = 0; k < m->num_collectives; k++) {
+    const CollectiveModel *coll = &m->collectives[k];
+    fprintf(f, "collectives %d", coll->size);
+    for (int c = 0; c < COLLECTIVES; c++) {
+      fprintf(f, " %g %g", coll->latency[c], coll->bw[c]);
+    }
+    fprintf(f, "\n");
+  }
+  for (int e = 0; e < MODEL_ESZ; e++) {
+    if (!m->has_elem[e]) {
+      continue;
+    }
+    fprintf(f, "datatypes %d %g %g\n", 1 << e, m->column_bw[e], m->subarray_bw[e]);
+    for (int k = 0; k < TILES; k++) {
+      fprintf(f, "kernel %d %d %g %g\n", 1 << e, model_tiles[k], m->kernel_small_bw[e][k], m->kernel_large_bw[e][k]);
+    }
+  }
+  fclose(f);
+}
+
+// Best time of `reps` runs of a memory copy of `bytes` bytes. The first copy also faults the
+// pages of the destination in: the difference with the best copy is stored in `fault`.
+static double time_memcpy(size_t bytes, int reps, double *fault) {
+  char *a = malloc(bytes), *b = malloc(bytes);
+  memset(a, 1, bytes);
+  double first = 0, best = INFINITY;
+  for (int r = 0; r < reps; r++) {
+    double start = MPI_Wtime();
+    memcpy(b, a, bytes);
+    double t = MPI_Wtime() - start;
+    first = r == 0 ? t : first;
+    best = fmin(best, t);
+  }
+  *fault = fmax(first - best, 1e-9);
+  free(a);
+  free(b);
+  return best;
+}
+
+// Round-trip time of a message of `bytes` bytes between the root and the last rank, halved
+static double time_ping_pong(size_t bytes, int reps, int rank, int size) {
+  char *buf = calloc(bytes + 1, 1);
+  int peer = rank == 0 ? size - 1 : 0;
+  MPI_Barrier(MPI_COMM_WORLD);
+  double start = MPI_Wtime();
+  for (int r = 0; r < reps && (rank == 0 || rank == size - 1); r++) {
+    if (rank == 0) {
+      MPI_Send(buf, (int) bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD);
+      MPI_Recv(buf, (int) bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    } else {
+      MPI_Recv(buf, (int) bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      MPI_Send(buf, (int) bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD);
+    }
+  }
+  double t = (MPI_Wtime() - start) / (2.0 * reps);
+  free(buf);
+  return t;
+}
+
+// Time of a collective moving `bytes` bytes from or to the root: the whole buffer for the
+// broadcast, bytes / size to or from every rank for MPI_Scatterv and MPI_Gatherv. Average of
+// `reps` runs after a warm-up run, on the slowest rank.
+static double time_collective(Collective op, size_t bytes, int reps, int size) {
+  int piece = (int) (bytes / size);
+  char *buf = calloc(bytes + 1, 1), *local = calloc((size_t) piece + 1, 1);
+  int *counts = malloc(size * sizeof(int)), *displs = malloc(size * sizeof(int));
+  for (int p = 0; p < size; p++) {
+    counts[p] = piece;
+    displs[p] = p * piece;
+  }
+  double start = 0;
+  for (int r = -1; r < reps; r++) {
+    if (r == 0) {
+      MPI_Barrier(MPI_COMM_WORLD);
+      start = MPI_Wtime();
+    }
+    if (op == COLLECTIVE_BCAST) {
+      MPI_Bcast(buf, (int) bytes, MPI_BYTE, 0, MPI_COMM_WORLD);
+    } else if (op == COLLECTIVE_SCATTER) {
+      MPI_Scatterv(buf, counts, displs, MPI_BYTE, local, piece, MPI_BYTE, 0, MPI_COMM_WORLD);
+    } else {
+      MPI_Gatherv(local, piece, MPI_BYTE, buf, counts, displs, MPI_BYTE, 0, MPI_COMM_WORLD);
+    }
+  }
+  double t = (MPI_Wtime() - start) / reps;
+  MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  free(buf);
+  free(local);
+  free(counts);
+  free(displs);
+  return t;
+}
+
+// Fit the latency and bandwidth of a collective to its times for a short and a long message
+static void fit_collective(Collective op, int size, double *latency, double *bw) {
+  size_t small = (size_t) size * 64, large = MODEL_COLLECTIVE_BYTES;
+  double t_small = time_collective(op, small, 50, size);
+  double t_large = time_collective(op, large, 5, size);
+  *bw = (large - small) / fmax(t_large - t_small, 1e-9);
+  *latency = fmax(t_small - small / *bw, 1e-9);
+}
+
+// Best time of `reps` copies of an n x n matrix to the same rank, received into the columns of
+// the destination (`columns`) or sent from a block of a 2n x 2n matrix
+static double time_datatype_copy(DType dt, int n, bool columns, int reps) {
+  size_t esz = dtype_size(dt);
+  MPI_Datatype elem_type = dtype_mpi_type(dt);
+  char *a = calloc((size_t) 4 * n * n, esz), *b = calloc((size_t) 4 * n * n, esz);
+  MPI_Datatype type;
+  if (columns) {
+    MPI_Datatype column;
+    MPI_Type_vector(n, 1, n, elem_type, &column);
+    MPI_Type_create_resized(column, 0, esz, &type);
+    MPI_Type_free(&column);
+  } else {
+    // Block of a matrix of twice the side, as in the grid of the blocked strategy
+    int sizes[] = {2 * n, 2 * n}, subsizes[] = {n, n}, starts[] = {0, 0};
+    MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, elem_type, &type);
+  }
+  MPI_Type_commit(&type);
+  double best = INFINITY;
+  for (int r = 0; r < reps; r++) {
+    double start = MPI_Wtime();
+    if (columns) {
+      MPI_Sendrecv(a, n * n, elem_type, 0, 0, b, n, type, 0, 0, MPI_COMM_SELF, MPI_STATUS_IGNORE);
+    } else {
+      MPI_Sendrecv(a, 1, type, 0, 0, b, n * n, elem_type, 0, 0, MPI_COMM_SELF, MPI_STATUS_IGNORE);
+    }
+    best = fmin(best, MPI_Wtime() - start);
+  }
+  MPI_Type_free(&type);
+  free(a);
+  free(b);
+  return best;
+}
+
+// Best time of `reps` single-thread transposes of an n x n matrix with the given local tile
+static double time_kernel(DType dt, int n, int tile, int reps) {
+  size_t esz = dtype_size(dt);
+  char *a = calloc((size_t) n * n, esz), *b = calloc((size_t) n * n, esz);
+  TransposePlan *plan = transpose_plan_create(n, n, 0, 0, dt, 1, tile, tile == 0 ? TRANSPOSE_UNTILED : 0);
+  double best = INFINITY;
+  for (int r = 0; r < reps; r++) {
+    double start = MPI_Wtime();
+    transpose_execute(plan, a, b);
+    best = fmin(best, MPI_Wtime() - start);
+  }
+  transpose_plan_destroy(plan);
+  free(a);
+  free(b);
+  return best;
+}
+
+// Calibrate the parts of the model missing for this run (all of them when `force` is set) and
+// share the model with every rank. Collective.
+static void calibrate(Model *m, DType dt, bool force, int rank, int size) {
+  size_t esz = dtype_size(dt);
+  int e = esz_index(esz);
+  if (rank == 0) {
+    if (force || !m->has_memory) {
+      double fault;
+      m->memory_bw = MODEL_LARGE_BYTES / time_memcpy(MODEL_LARGE_BYTES, 5, &fault);
+      m->fault_bw = MODEL_LARGE_BYTES / fault;
+      m->has_memory = true;
+    }
+    if (force || !m->has_elem[e]) {
+      int large = (int) sqrt(MODEL_LARGE_BYTES / esz);
+      int small = (int) sqrt(MODEL_CACHE_BYTES / 2 / esz);
+      double bytes = (double) large * large * esz;
+      m->column_bw[e] = bytes / time_datatype_copy(dt, large, true, 3);
+      m->subarray_bw[e] = bytes / time_datatype_copy(dt, large, false, 3);
+      for (int k = 0; k < TILES; k++) {
+        m->kernel_small_bw[e][k] = (double) small * small * esz / time_kernel(dt, small, model_tiles[k], 50);
+        m->kernel_large_bw[e][k] = bytes / time_kernel(dt, large, model_tiles[k], 3);
+      }
+      m->has_elem[e] = true;
+    }
+  }
+  // The network can only be measured with several ranks, the first run with several calibrates it
+  int need_network = rank == 0 && size > 1 && (force || !m->has_network);
+  MPI_Bcast(&need_network, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (need_network) {
+    size_t bytes = 4 << 20;
+    double latency = time_ping_pong(0, 100, rank, size);
+    double t = time_ping_pong(bytes, 10, rank, size);
+    m->latency = latency;
+    m->network_bw = bytes / fmax(t - latency, 1e-9);
+    m->has_network = true;
+  }
+  // The collectives depend on the number of processes, the first run with each measures them.
+  // Only the root holds the model until it is broadcast below.
+  int need_collectives = rank == 0 && (force || find_collectives(m, size) == NULL);
+  MPI_Bcast(&need_collectives, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (need_collectives) {
+    double latency[COLLECTIVES], bw[COLLECTIVES];
+    for (int c = 0; c < COLLECTIVES; c++) {
+      fit_collective((Collective) c, size, &latency[c], &bw[c]);
+    }
+    if (rank == 0) {
+      CollectiveModel *coll = add_collectives(m, size);
+      memcpy(coll->latency, latency, sizeof(latency));
+      memcpy(coll->bw, bw, sizeof(bw));
+    }
+  }
+  MPI_Bcast(m, sizeof(Model), MPI_BYTE, 0, MPI_COMM_WORLD);
+}
+
+// Side of the square process grid of the blocked strategy, 0 if it cannot be used
+static int grid_side(int N, int size) {
+  int grid = (int) sqrt(size);
+  while (grid * grid > size) {
+    grid--;
+  }
+  while ((grid + 1) * (grid + 1) <= size) {
+    grid++;
+  }
+  return grid * grid == size && N % grid == 0 ? grid : 0;
+}
+
+// Time of a collective of the model moving `bytes` bytes from or to the root. The fit comes
+// from messages of MODEL_COLLECTIVE_BYTES; for larger matrices it is bounded below by the time
+// the root needs to push the pieces of the other ranks through its point-to-point link.
+static double collective_time(const Model *m, const CollectiveModel *c, Collective op, double bytes) {
+  double fit = c->latency[op] + bytes / c->bw[op];
+  if (!m->has_network || c->size == 1) {
+    return fit;
+  }
+  return fmax(fit, m->latency + bytes * (c->size - 1) / c->size / m->network_bw);
+}
+
+// Predicted time of a variant for an N x N matrix of esz-byte elements over `size` ranks,
+// INFINITY if the variant cannot be used. Every strategy moves the matrix through the root
+// with the calibrated collectives, packs or unpacks it through its datatypes on the root, and
+// waits for the slowest local transpose. The buffers of the plan and the transposed matrix are
+// written for the first time, so their page faults are counted.
+static double predict(const Model *m, const Variant *v, int N, size_t esz, int size) {
+  int e = esz_index(esz);
+  const CollectiveModel *c = find_collectives(m, size);
+  if (c == NULL) {
+    return INFINITY;
+  }
+  double bytes = (double) N * N * esz;
+  double scatter = collective_time(m, c, COLLECTIVE_SCATTER, bytes);
+  double gather_columns = collective_time(m, c, COLLECTIVE_GATHER, bytes) + bytes / m->column_bw[e];
+  double faults = bytes / m->fault_bw;
+  switch (v->strategy) {
+    case TRANSPOSE_MPI_BROADCAST:
+      // The other ranks receive the whole matrix
+      return collective_time(m, c, COLLECTIVE_BCAST, bytes) + gather_columns + (size > 1 ? 2 : 1) * faults;
+    case TRANSPOSE_MPI_SCATTER:
+      return scatter + gather_columns + (1 + 1.0 / size) * faults;
+    case TRANSPOSE_MPI_BLOCKS: {
+      int grid = grid_side(N, size);
+      if (grid == 0) {
+        return INFINITY;
+      }
+      double block_bytes = (double) (N / grid) * (N / grid) * esz;
+      int k = tile_index(v->tile);
+      double kernel_bw = 2 * block_bytes <= MODEL_CACHE_BYTES ? m->kernel_small_bw[e][k] : m->kernel_large_bw[e][k];
+      return scatter + collective_time(m, c, COLLECTIVE_GATHER, bytes) + 2 * bytes / m->subarray_bw[e] +
+             block_bytes / kernel_bw + (1 + 2.0 / size) * faults;
+    }
+  }
+  return INFINITY;
+}
+
+int main(int argc, char *argv[]) {
+
+  MPI_Init(&argc, &argv);
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  char **mat = NULL, **mat_t = NULL;
+  bool check, verbose, conj;
+  Timer transpose_timer;
+  int N;
+  DType dt;
+
+  parse_dtype_args(&argc, argv, &dt, &conj);
+  const char *variant_name = take_option(&argc, argv, "--variant", true);
+  const char *model_path = take_option(&argc, argv, "--model", true);
+  // Measure the machine again instead of using the saved model
+  bool force = take_option(&argc, argv, "--calibrate", false) != NULL;
+  // Only print the predictions, for sizes that cannot be run
+  bool predict_only = take_option(&argc, argv, "--predict", false) != NULL;
+  parse_args(argc, argv, &N, &check, &verbose);
+  // The model describes the machine, so the default file is kept per host: jobs on different
+  // nodes or partitions sharing a directory do not reuse each other's model
+  char default_path[MPI_MAX_PROCESSOR_NAME + 32];
+  if (model_path == NULL) {
+    char host[MPI_MAX_PROCESSOR_NAME];
+    int len;
+    MPI_Get_processor_name(host, &len);
+    host[strcspn(host, ".")] = '\0';
+    snprintf(default_path, sizeof(default_path), "transpose_model_%s.txt", host);
+    model_path = default_path;
+  }
+  srand(time(NULL));
+
+  // Only the root loads the model, the others receive it at the end of the calibration
+  Model model;
+  memset(&model, 0, sizeof(model));
+  if (rank == 0) {
+    load_model(model_path, &model);
+  }
+  calibrate(&model, dt, force, rank, size);
+  if (rank == 0) {
+    save_model(model_path, &model);
+  }
+
+  // Rank the variants by predicted time; `auto` runs the fastest, a named variant runs that one
+  double predicted[VARIANTS];
+  int chosen = -1;
+  for (int k = 0; k < VARIANTS; k++) {
+    predicted[k] = predict(&model, &variants[k], N, dtype_size(dt), size);
+    bool named = variant_name != NULL && strcmp(variant_name, "auto") != 0;
+    if (named ? strcmp(variant_name, variants[k].name) == 0
+              : predicted[k] < INFINITY && (chosen < 0 || predicted[k] < predicted[chosen])) {
+      chosen = k;
+    }
+  }
+  if (chosen < 0) {
+    if (rank == 0) {
+      printf("Error: unknown variant %s (auto", variant_name);
+      for (int k = 0; k < VARIANTS; k++) {
+        printf(", %s", variants[k].name);
+      }
+      printf(")\n");
+    }
+    MPI_Finalize();
+    return 1;
+  }
+  if (rank == 0 && (verbose || predict_only)) {
+    if (model.has_network) {
+      printf("network_latency: %g, network_bw: %g\n", model.latency, model.network_bw);
+    }
+    for (int k = 0; k < VARIANTS; k++) {
+      if (predicted[k] < INFINITY) {
+        printf("variant: %s, predicted_time: %f%s\n", variants[k].name, predicted[k], k == chosen ? " (selected)" : "");
+      } else {
+        printf("variant: %s, unavailable for this size and number of processes\n", variants[k].name);
+      }
+    }
+  }
+  if (predict_only) {
+    MPI_Finalize();
+    return 0;
+  }
+
+  const Variant *v = &variants[chosen];
+  unsigned flags = (conj ? TRANSPOSE_CONJ : 0) | (v->strategy == TRANSPOSE_MPI_BLOCKS && v->tile == 0 ? TRANSPOSE_UNTILED : 0);
+  TransposeMPIPlan *plan = transpose_mpi_plan_create(MPI_COMM_WORLD, 0, N, dt, v->strategy, v->tile, flags);
+  if (plan == NULL) {
+    MPI_Finalize();
+    return 1;
+  }
+
+  // Only the root holds the matrices
+  if (rank == 0) {
+    init_matrix(N, N, dtype_size(dt), &mat);
+    init_matrix(N, N, dtype_size(dt), &mat_t);
+    fill_rand_matrix(N, dt, &mat);
+    if (verbose) {
+      print_matrix(N, dt, mat);
+    }
+  }
+
+  transpose_timer.start = MPI_Wtime();
+  transpose_mpi_execute(plan, rank == 0 ? mat[0] : NULL, rank == 0 ? mat_t[0] : NULL);
+  transpose_timer.end = MPI_Wtime();
+
+  if (rank == 0) {
+    if (verbose) {
+      print_matrix(N, dt, mat_t);
+    }
+    if (check) {
+      check_correctness(N, dt, conj, mat, mat_t);
+    }
+    printf("threads: %d, variant: %s, predicted_time: %f, transpose_time: %f\n", size, v->name, predicted[chosen], get_time(transpose_timer));
+  }
+
+  transpose_mpi_plan_destroy(plan);
+  MPI_Finalize();
+  return 0;
+}
@@ -1,86 +1,13 @@
-#include <math.h>
 #include <mpi.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 #include <stdbool.h>
 #include "utils.h"
+#include "mpi_utils.h"
 
 #define INNER_BLOCK_SIZE 64
 
-void transpose(int N, float** mat, float** mat_t, int rank, int size) {
-  int outer_block_length = N / (int) sqrt(size);
-  int outer_block_size = outer_block_length * outer_block_length;
-  float **mat_local;
-  float **mat_local_t;
-  init_matrix(outer_block_length, outer_block_length, &mat_local);
-  init_matrix(outer_block_length, outer_block_length, &mat_local_t);
-  int *disp, *count;
-  MPI_Datatype send_type, resized_type;
-
-  int array_elements[] = {N, N};
-  int array_of_subsizes[] = {outer_block_length, outer_block_length};
-  int array_of_starts[] = {0, 0};
-  MPI_Type_create_subarray(2, array_elements, array_of_subsizes, array_of_starts, MPI_ORDER_C, MPI_FLOAT, &send_type);
-  MPI_Type_commit(&send_type);
-  MPI_Type_create_resized(send_type, 0, outer_block_length*sizeof(float), &resized_type);
-  MPI_Type_commit(&resized_type);
-  if (rank == 0) {
-    if (outer_block_length * (int) sqrt(size) != N) {
-      printf("Number of threads must be a square!\n");
-      return;
-    }
-    if (N % outer_block_length != 0) {
-      printf("Matrix size must be divisible by sqrt(size)!\n");
-      return;
-    }
-
-    disp = calloc(size,sizeof(int));
-    count = calloc(size,sizeof(int));
-    for (int i = 0; i < size; ++i) {
-      disp[i] = 
-        ((i) % (N / outer_block_length)) + 
-        ((i * outer_block_length) / N) * N;
-      count[i] = 1;
-    }
-    MPI_Scatterv(mat[0], count, disp, resized_type, mat_local[0], outer_block_size, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  } else {
-    MPI_Scatterv(NULL, NULL, NULL, MPI_FLOAT, mat_local[0], outer_block_size, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  }
-
-  // Transpose the local block by smaller blocks
-  for (int i = 0; i < outer_block_length; i += INNER_BLOCK_SIZE) {
-    for (int j = 0; j < outer_block_length; j += INNER_BLOCK_SIZE) {
-      int iend = (i + INNER_BLOCK_SIZE < outer_block_length) ? i + INNER_BLOCK_SIZE : outer_block_length;
-      int jend = (j + INNER_BLOCK_SIZE < outer_block_length) ? j + INNER_BLOCK_SIZE : outer_block_length;
-      for (int ii = i; ii < iend; ii++) {
-        for (int jj = j; jj < jend; jj++) {
-          mat_t[jj][ii] = mat_local[ii][jj];
-        }
-      }
-    }
-  }
-
-  // Transpose local block
-  for (int i = 0; i < outer_block_length; i++) {
-    for (int j = 0; j < outer_block_length; j++) {
-      mat_local_t[j][i] = mat_local[i][j];
-    }
-  }
-  
-  if (rank == 0) {
-    for (int i = 0; i < size; ++i) {
-      disp[i] = 
-        ((i) % (N / outer_block_length)) * N + 
-        ((i * outer_block_length) / N);
-      count[i] = 1;
-    }
-    MPI_Gatherv(mat_local_t[0], outer_block_size, MPI_FLOAT, mat_t[0], count, disp, resized_type, 0, MPI_COMM_WORLD);
-  } else {
-    MPI_Gatherv(mat_local_t[0], outer_block_size, MPI_FLOAT, NULL, 0, NULL, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  }
-}
-
 int main(int argc, char *argv[]) {
   
   MPI_Init(&argc, &argv);
@@ -88,39 +15,80 @@ int main(int argc, char *argv[]) {
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   
-  float **mat, **mat_t;
-  bool check, verbose;
+  char **mat = NULL, **mat_t = NULL;
+  bool check, verbose, conj;
   Timer transpose_timer;
   int N;
+  DType dt;
 
+  parse_dtype_args(&argc, argv, &dt, &conj);
+  unsigned wire = parse_wire(take_option(&argc, argv, "--wire", true));
+  bool hierarchical = take_option(&argc, argv, "--hierarchical", false) != NULL;
+  bool tiled = take_option(&argc, argv, "--tiled", false) != NULL;
   parse_args(argc, argv, &N, &check, &verbose);
   srand(time(NULL));
+
+  // Square blocks are scattered, each one is transposed locally by smaller blocks
+  TransposeMPIPlan *plan = transpose_mpi_plan_create(MPI_COMM_WORLD, 0, N, dt, TRANSPOSE_MPI_BLOCKS, INNER_BLOCK_SIZE, (conj ? TRANSPOSE_CONJ : 0) | wire | (hierarchical ? TRANSPOSE_MPI_HIERARCHICAL : 0) | (tiled ? TRANSPOSE_MPI_TILED : 0));
+  if (plan == NULL) {
+    MPI_Finalize();
+    return 1;
+  }
   
-  init_matrix(N, N, &mat);
-  init_matrix(N, N, &mat_t);
-  
+  // Only the root holds the matrices
   if (rank == 0) {
-    fill_rand_matrix(N, &mat);
+    init_matrix(N, N, dtype_size(dt), &mat);
+    init_matrix(N, N, dtype_size(dt), &mat_t);
+    fill_rand_matrix(N, dt, &mat);
     if (verbose) {
-      print_matrix(N, mat);
+      print_matrix(N, dt, mat);
+    }
+  }
+  
+  // With --tiled the root keeps the matrices in the tiled layout of the plan, converted outside
+  // the timed region
+  const TransposeLayout *layout = transpose_mpi_plan_layout(plan);
+  char *src = NULL, *dst = NULL;
+  if (rank == 0) {
+    src = mat[0];
+    dst = mat_t[0];
+    if (layout != NULL) {
+      src = (char *) malloc(transpose_layout_size(layout) * dtype_size(dt));
+      dst = (char *) malloc(transpose_layout_size(layout) * dtype_size(dt));
+      transpose_layout_pack(layout, dt, mat[0], 0, src, 0);
     }
   }
   
   transpose_timer.start = MPI_Wtime();
-  MPI_Bcast(mat[0], N*N, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  transpose(N, mat, mat_t, rank, size);
+  transpose_mpi_execute(plan, src, dst);
   transpose_timer.end = MPI_Wtime();
   
   if (rank == 0) {
+    if (layout != NULL) {
+      transpose_layout_unpack(layout, dt, dst, mat_t[0], 0, 0);
+      free(src);
+      free(dst);
+    }
     if (verbose) {
-      print_matrix(N, mat_t);
+      print_matrix(N, dt, mat_t);
+    }
+    // The bf16 and half wire formats round the elements, which are compared with the rounded input
+    bool lossy = wire == TRANSPOSE_WIRE_BF16 || wire == TRANSPOSE_WIRE_HALF;
+    if (check && lossy) {
+      check_rounded_correctness(N, wire == TRANSPOSE_WIRE_BF16 ? DTYPE_BF16 : DTYPE_HALF, mat, mat_t);
+    } else if (check) {
+      check_correctness(N, dt, conj, mat, mat_t);
     }
-    if (check) {
-      check_correctness(N, mat, mat_t);
+    size_t wire_bytes, native_bytes;
+    transpose_mpi_wire_stats(plan, &wire_bytes, &native_bytes);
+    printf("threads: %d, transpose_time: %f, wire_bytes: %zu, native_bytes: %zu", size, get_time(transpose_timer), wire_bytes, native_bytes);
+    if (lossy) {
+      printf(", max_error: %g", max_transpose_error(N, mat, mat_t));
     }
-    printf("threads: %d, transpose_time: %f\n", size, get_time(transpose_timer));
+    printf("\n");
   }
 
+  transpose_mpi_plan_destroy(plan);
   MPI_Finalize();
   return 0;
-}
\ No newline at end of file
+}
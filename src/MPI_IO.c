@@ -0,0 +1,209 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "utils.h"
+#include "mpi_utils.h"
+#include "transpose.h"
+
+// Block of the matrix owned by a rank of the 2D process grid
+typedef struct {
+  int row_start, rows;
+  int col_start, cols;
+} LocalBlock;
+
+/// Split N rows and columns over a 2D grid of processes. The grid is chosen by MPI_Dims_create,
+/// so any number of processes is supported and the blocks differ by at most one row/column.
+LocalBlock get_local_block(int N, int rank, int size) {
+  int dims[2] = {0, 0};
+  MPI_Dims_create(size, 2, dims);
+  // Every rank needs at least one row and one column
+  if (N < dims[0] || N < dims[1]) {
+    if (rank == 0) {
+      printf("Error: matrix_dim must be at least %d for a %d x %d process grid\n", dims[0] > dims[1] ? dims[0] : dims[1], dims[0], dims[1]);
+    }
+    MPI_Finalize();
+    exit(1);
+  }
+  int grid_row = rank / dims[1];
+  int grid_col = rank % dims[1];
+  LocalBlock block;
+  int remainder = N % dims[0];
+  block.row_start = grid_row * (N / dims[0]) + (grid_row < remainder ? grid_row : remainder);
+  block.rows = N / dims[0] + (grid_row < remainder ? 1 : 0);
+  remainder = N % dims[1];
+  block.col_start = grid_col * (N / dims[1]) + (grid_col < remainder ? grid_col : remainder);
+  block.cols = N / dims[1] + (grid_col < remainder ? 1 : 0);
+  return block;
+}
+
+/// Open `path` and set a view selecting the rows x cols block starting at (row_start, col_start)
+/// of the N x N matrix of `elem_type` elements stored in the file.
+MPI_File open_block_view(const char *path, int amode, MPI_Datatype elem_type, int N, int row_start, int rows, int col_start, int cols) {
+  MPI_File fh;
+  MPI_Info info;
+  MPI_Info_create(&info);
+  // Let the MPI-IO layer aggregate the strided accesses of all ranks into large file requests
+  MPI_Info_set(info, "romio_cb_read", "enable");
+  MPI_Info_set(info, "romio_cb_write", "enable");
+  if (MPI_File_open(MPI_COMM_WORLD, path, amode, info, &fh) != MPI_SUCCESS) {
+    fprintf(stderr, "Error: cannot open %s\n", path);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  MPI_Info_free(&info);
+
+  MPI_Datatype file_type;
+  int array_elements[] = {N, N};
+  int array_of_subsizes[] = {rows, cols};
+  int array_of_starts[] = {row_start, col_start};
+  MPI_Type_create_subarray(2, array_elements, array_of_subsizes, array_of_starts, MPI_ORDER_C, elem_type, &file_type);
+  MPI_Type_commit(&file_type);
+  MPI_File_set_view(fh, 0, elem_type, file_type, "native", MPI_INFO_NULL);
+  MPI_Type_free(&file_type);
+  return fh;
+}
+
+/// Write an N x N matrix of generated values to `path`. Each rank writes its own block.
+void generate_matrix(const char *path, DType dt, int N, int rank, int size) {
+  LocalBlock block = get_local_block(N, rank, size);
+  size_t esz = dtype_size(dt);
+  char **mat_local;
+  init_matrix(block.rows, block.cols, esz, &mat_local);
+  for (int i = 0; i < block.rows; i++) {
+    for (int j = 0; j < block.cols; j++) {
+      set_gen_value(dt, ELEM(mat_local, i, j, esz), block.row_start + i, block.col_start + j, N);
+    }
+  }
+  MPI_File fh = open_block_view(path, MPI_MODE_CREATE | MPI_MODE_WRONLY, dtype_mpi_type(dt), N, block.row_start, block.rows, block.col_start, block.cols);
+  MPI_File_set_size(fh, (MPI_Offset) N * N * esz);
+  MPI_Datatype row_type = create_row_type(block.cols, dtype_mpi_type(dt));
+  MPI_File_write_all(fh, mat_local[0], block.rows, row_type, MPI_STATUS_IGNORE);
+  MPI_Type_free(&row_type);
+  MPI_File_close(&fh);
+}
+
+/// Read back the transposed block of each rank from `path` and check it against the generated
+/// input. The result is reduced on rank 0.
+bool check_output(const char *path, DType dt, bool conj, int N, LocalBlock block) {
+  size_t esz = dtype_size(dt);
+  char **mat_t;
+  init_matrix(block.cols, block.rows, esz, &mat_t);
+  MPI_File fh = open_block_view(path, MPI_MODE_RDONLY, dtype_mpi_type(dt), N, block.col_start, block.cols, block.row_start, block.rows);
+  MPI_Datatype row_type = create_row_type(block.rows, dtype_mpi_type(dt));
+  MPI_File_read_all(fh, mat_t[0], block.cols, row_type, MPI_STATUS_IGNORE);
+  MPI_Type_free(&row_type);
+  MPI_File_close(&fh);
+
+  int correct = 1, all_correct;
+  for (int j = 0; j < block.cols && correct; j++) {
+    for (int i = 0; i < block.rows; i++) {
+      char expected[16];
+      set_gen_value(dt, expected, block.row_start + i, block.col_start + j, N);
+      if (!dtype_equal(dt, expected, ELEM(mat_t, j, i, esz), conj)) {
+        printf("Error: mat_t[%d][%d] = ", block.col_start + j, block.row_start + i);
+        dtype_print(dt, ELEM(mat_t, j, i, esz));
+        printf(", expected ");
+        dtype_print(dt, expected);
+        printf("\n");
+        correct = 0;
+        break;
+      }
+    }
+  }
+  MPI_Reduce(&correct, &all_correct, 1, MPI_INT, MPI_LAND, 0, MPI_COMM_WORLD);
+  free(mat_t[0]);
+  free(mat_t);
+  return all_correct;
+}
+
+int main(int argc, char *argv[]) {
+
+  MPI_Init(&argc, &argv);
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  DType dt;
+  bool conj;
+  parse_dtype_args(&argc, argv, &dt, &conj);
+  MPI_Datatype elem_type = dtype_mpi_type(dt);
+  size_t esz = dtype_size(dt);
+  bool generate = argc == 4 && strcmp(argv[1], "generate") == 0;
+  if (!generate && (argc < 4 || argc >= 7)) {
+    if (rank == 0) {
+      printf("Usage: %s <matrix_dim> <input_file> <output_file> [<check_correctness>] [<verbose>] [--dtype <type>] [--conj]\n", argv[0]);
+      printf("       %s generate <matrix_dim> <output_file> [--dtype <type>]\n", argv[0]);
+    }
+    MPI_Finalize();
+    return 1;
+  }
+  int N = atoi(argv[generate ? 2 : 1]);
+  if (N <= 0) {
+    if (rank == 0) {
+      printf("Error: matrix_dim must be a positive integer\n");
+    }
+    MPI_Finalize();
+    return 1;
+  }
+  if (generate) {
+    generate_matrix(argv[3], dt, N, rank, size);
+    MPI_Finalize();
+    return 0;
+  }
+  bool check = argc >= 5 && strcmp(argv[4], "check") == 0;
+  bool verbose = argc >= 6 && strcmp(argv[5], "verbose") == 0;
+
+  char **mat_local, **mat_local_t;
+  Timer read_timer, transpose_timer, write_timer;
+  LocalBlock block = get_local_block(N, rank, size);
+  init_matrix(block.rows, block.cols, esz, &mat_local);
+  init_matrix(block.cols, block.rows, esz, &mat_local_t);
+
+  // Each rank reads its own block through a subarray view of the input file
+  MPI_Barrier(MPI_COMM_WORLD);
+  read_timer.start = MPI_Wtime();
+  MPI_File fh_in = open_block_view(argv[2], MPI_MODE_RDONLY, elem_type, N, block.row_start, block.rows, block.col_start, block.cols);
+  MPI_Datatype row_type = create_row_type(block.cols, elem_type);
+  MPI_File_read_all(fh_in, mat_local[0], block.rows, row_type, MPI_STATUS_IGNORE);
+  MPI_Type_free(&row_type);
+  MPI_File_close(&fh_in);
+  read_timer.end = MPI_Wtime();
+
+  TransposePlan *plan = transpose_plan_create(block.rows, block.cols, 0, 0, dt, 1, 0, conj ? TRANSPOSE_CONJ : 0);
+  transpose_timer.start = MPI_Wtime();
+  transpose_execute(plan, mat_local[0], mat_local_t[0]);
+  transpose_timer.end = MPI_Wtime();
+  transpose_plan_destroy(plan);
+
+  // The transposed block is written straight to its final position, no gather on rank 0
+  write_timer.start = MPI_Wtime();
+  MPI_File fh_out = open_block_view(argv[3], MPI_MODE_CREATE | MPI_MODE_WRONLY, elem_type, N, block.col_start, block.cols, block.row_start, block.rows);
+  MPI_File_set_size(fh_out, (MPI_Offset) N * N * esz);
+  row_type = create_row_type(block.rows, elem_type);
+  MPI_File_write_all(fh_out, mat_local_t[0], block.cols, row_type, MPI_STATUS_IGNORE);
+  MPI_Type_free(&row_type);
+  MPI_File_close(&fh_out);
+  write_timer.end = MPI_Wtime();
+
+  double times[3] = {get_time(read_timer), get_time(transpose_timer), get_time(write_timer)};
+  double max_times[3];
+  MPI_Reduce(times, max_times, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+  bool correct = check ? check_output(argv[3], dt, conj, N, block) : true;
+  if (rank == 0) {
+    if (verbose) {
+      int dims[2] = {0, 0};
+      MPI_Dims_create(size, 2, dims);
+      printf("Process grid: %d x %d\n", dims[0], dims[1]);
+      printf("Read time: %.9fs, transpose time: %.9fs, write time: %.9fs\n", max_times[0], max_times[1], max_times[2]);
+    }
+    if (check && correct) {
+      printf("Matrix transpose is correct\n");
+    }
+    printf("threads: %d, transpose_time: %f, read_time: %f, write_time: %f\n", size,
+           max_times[0] + max_times[1] + max_times[2], max_times[0], max_times[2]);
+  }
+
+  MPI_Finalize();
+  return 0;
+}
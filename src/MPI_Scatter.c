@@ -4,44 +4,7 @@
 #include <time.h>
 #include <stdbool.h>
 #include "utils.h"
-
-void transpose(int N, float** mat, float** mat_t, int rank, int size) {
-  int remainder = N % size;
-  int start = rank * (N / size) + (rank < remainder ? rank : remainder);
-  int end = start + N / size + (rank < remainder ? 1 : 0);
-  
-  float **mat_local;
-  init_matrix(end - start, N, &mat_local);
-  int *disp, *count;
-
-  if (rank == 0) {
-    MPI_Datatype send_type;
-    MPI_Type_vector(1, N, N, MPI_FLOAT, &send_type);
-    MPI_Type_commit(&send_type);
-    disp = calloc(size,sizeof(int));
-    count = calloc(size,sizeof(int));
-    for (int i = 0; i < size; ++i) {
-      disp[i] = i * (N / size) + (i < remainder ? i : remainder);
-      count[i] = N / size + (i < remainder ? 1 : 0);
-    }
-
-    MPI_Scatterv(mat[0], count, disp, send_type, mat_local[0], (end - start)*N, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  } else {
-    MPI_Scatterv(NULL, NULL, NULL, MPI_FLOAT, mat_local[0], (end - start)*N, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  }
-  
-  MPI_Datatype recv_type, new_recv_type;
-  MPI_Type_vector(N, 1, N, MPI_FLOAT, &recv_type);
-  MPI_Type_commit(&recv_type);
-
-  MPI_Type_create_resized(recv_type, 0, 1*sizeof(float), &new_recv_type);
-  MPI_Type_commit(&new_recv_type);
-  if (rank == 0) {
-    MPI_Gatherv(mat_local[0], (end-start)*N, MPI_FLOAT, mat_t[0], count, disp, new_recv_type, 0, MPI_COMM_WORLD);
-  } else {
-    MPI_Gatherv(mat_local[0], (end-start)*N, MPI_FLOAT, NULL, 0, NULL, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  }
-}
+#include "mpi_utils.h"
 
 int main(int argc, char *argv[]) {
   
@@ -50,39 +13,60 @@ int main(int argc, char *argv[]) {
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   
-  float **mat, **mat_t;
-  bool check, verbose;
+  char **mat = NULL, **mat_t = NULL;
+  bool check, verbose, conj;
   Timer transpose_timer;
   int N;
+  DType dt;
 
+  parse_dtype_args(&argc, argv, &dt, &conj);
+  unsigned wire = parse_wire(take_option(&argc, argv, "--wire", true));
+  bool hierarchical = take_option(&argc, argv, "--hierarchical", false) != NULL;
   parse_args(argc, argv, &N, &check, &verbose);
   srand(time(NULL));
+
+  // Bands of rows are scattered and gathered back as columns
+  TransposeMPIPlan *plan = transpose_mpi_plan_create(MPI_COMM_WORLD, 0, N, dt, TRANSPOSE_MPI_SCATTER, 0, (conj ? TRANSPOSE_CONJ : 0) | wire | (hierarchical ? TRANSPOSE_MPI_HIERARCHICAL : 0));
+  if (plan == NULL) {
+    MPI_Finalize();
+    return 1;
+  }
   
-  init_matrix(N, N, &mat);
-  init_matrix(N, N, &mat_t);
-  
+  // Only the root holds the matrices
   if (rank == 0) {
-    fill_rand_matrix(N, &mat);
+    init_matrix(N, N, dtype_size(dt), &mat);
+    init_matrix(N, N, dtype_size(dt), &mat_t);
+    fill_rand_matrix(N, dt, &mat);
     if (verbose) {
-      print_matrix(N, mat);
+      print_matrix(N, dt, mat);
     }
   }
   
   transpose_timer.start = MPI_Wtime();
-  MPI_Bcast(mat[0], N*N, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  transpose(N, mat, mat_t, rank, size);
+  transpose_mpi_execute(plan, rank == 0 ? mat[0] : NULL, rank == 0 ? mat_t[0] : NULL);
   transpose_timer.end = MPI_Wtime();
   
   if (rank == 0) {
     if (verbose) {
-      print_matrix(N, mat_t);
+      print_matrix(N, dt, mat_t);
     }
-    if (check) {
-      check_correctness(N, mat, mat_t);
+    // The bf16 and half wire formats round the elements, which are compared with the rounded input
+    bool lossy = wire == TRANSPOSE_WIRE_BF16 || wire == TRANSPOSE_WIRE_HALF;
+    if (check && lossy) {
+      check_rounded_correctness(N, wire == TRANSPOSE_WIRE_BF16 ? DTYPE_BF16 : DTYPE_HALF, mat, mat_t);
+    } else if (check) {
+      check_correctness(N, dt, conj, mat, mat_t);
     }
-    printf("threads: %d, transpose_time: %f\n", size, get_time(transpose_timer));
+    size_t wire_bytes, native_bytes;
+    transpose_mpi_wire_stats(plan, &wire_bytes, &native_bytes);
+    printf("threads: %d, transpose_time: %f, wire_bytes: %zu, native_bytes: %zu", size, get_time(transpose_timer), wire_bytes, native_bytes);
+    if (lossy) {
+      printf(", max_error: %g", max_transpose_error(N, mat, mat_t));
+    }
+    printf("\n");
   }
 
+  transpose_mpi_plan_destroy(plan);
   MPI_Finalize();
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,312 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+#include "utils.h"
+#include "mpi_utils.h"
+#include "sparse.h"
+
+// First row of the band of `rank` when `rows` rows are split among `size` ranks
+static int band_first(int rows, int rank, int size) {
+  return (int) ((int64_t) rows * rank / size);
+}
+
+// Rank whose band holds row `row`: the largest p with band_first(rows, p, size) <= row
+static int band_owner(int rows, int row, int size) {
+  return (int) ((((int64_t) row + 1) * size - 1) / rows);
+}
+
+// Transpose a distributed matrix. Every rank holds the band of rows of A starting at row0 and
+// receives the band of rows of the transpose (columns of A) it owns: the elements are bucketed
+// by destination rank, exchanged with one MPI_Alltoallv for the (row, column) pairs and one for
+// the values, and sorted into rows with a counting sort. Since the ranks hold increasing bands
+// of A, the rows of the local transpose come out sorted. Returns false on every rank if a rank
+// cannot allocate its buffers or the counts are too large for the MPI library.
+bool sparse_transpose_mpi(const SparseMatrix *a, int row0, int total_rows, SparseMatrix *t, bool conj,
+                          MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  size_t esz = dtype_size(a->dt);
+  MPI_Datatype type = dtype_mpi_type(a->dt);
+  int64_t *send_counts = calloc(size, sizeof(int64_t)), *recv_counts = malloc(size * sizeof(int64_t));
+  int64_t *send_displs = malloc(size * sizeof(int64_t)), *recv_displs = malloc(size * sizeof(int64_t));
+
+  for (int64_t e = 0; e < a->nnz; e++) {
+    send_counts[band_owner(a->cols, a->col_idx[e], size)]++;
+  }
+  MPI_Alltoall(send_counts, 1, MPI_INT64_T, recv_counts, 1, MPI_INT64_T, comm);
+  int64_t sent = 0, received = 0;
+  for (int p = 0; p < size; p++) {
+    send_displs[p] = sent;
+    recv_displs[p] = received;
+    sent += send_counts[p];
+    received += recv_counts[p];
+  }
+
+  // (row, column) pairs travel as one element of a 2-int datatype, with the counts of the values
+  int col0 = band_first(a->cols, rank, size);
+  int cols = band_first(a->cols, rank + 1, size) - col0;
+  MPI_Datatype pair_type = create_row_type(2, MPI_INT);
+  int *send_pairs = malloc(((size_t) sent + 1) * 2 * sizeof(int));
+  int *recv_pairs = malloc(((size_t) received + 1) * 2 * sizeof(int));
+  char *send_values = malloc(((size_t) sent + 1) * esz);
+  char *recv_values = malloc(((size_t) received + 1) * esz);
+  int64_t *next = malloc(size * sizeof(int64_t));
+  int64_t *fill = malloc(((size_t) cols + 1) * sizeof(int64_t));
+  bool ok = sparse_alloc(t, cols, total_rows, received, a->dt);
+  ok = ok && send_pairs != NULL && recv_pairs != NULL && send_values != NULL && recv_values != NULL && fill != NULL;
+  if (!ok) {
+    printf("Error: rank %d cannot allocate the buffers of %lld elements\n", rank, (long long) (sent + received));
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_C_BOOL, MPI_LAND, comm);
+
+  if (ok) {
+    // Pack pairs and values by destination, keeping the rows in order
+    memcpy(next, send_displs, size * sizeof(int64_t));
+    for (int i = 0; i < a->rows; i++) {
+      for (int64_t e = a->row_ptr[i]; e < a->row_ptr[i + 1]; e++) {
+        int c = a->col_idx[e];
+        int64_t pos = next[band_owner(a->cols, c, size)]++;
+        send_pairs[2 * pos] = row0 + i;
+        send_pairs[2 * pos + 1] = c;
+        memcpy(send_values + pos * esz, (const char *) a->values + e * esz, esz);
+      }
+    }
+    ok = alltoallv_large(send_values, send_counts, send_displs, recv_values, recv_counts, recv_displs, type, comm) &&
+         alltoallv_large(send_pairs, send_counts, send_displs, recv_pairs, recv_counts, recv_displs, pair_type, comm);
+  }
+
+  if (ok) {
+    // Counting sort of the received elements by column of A, i.e. row of the transpose
+    memset(t->row_ptr, 0, ((size_t) cols + 1) * sizeof(int64_t));
+    for (int64_t e = 0; e < received; e++) {
+      t->row_ptr[recv_pairs[2 * e + 1] - col0 + 1]++;
+    }
+    for (int c = 0; c < cols; c++) {
+      t->row_ptr[c + 1] += t->row_ptr[c];
+    }
+    memcpy(fill, t->row_ptr, ((size_t) cols + 1) * sizeof(int64_t));
+    for (int64_t e = 0; e < received; e++) {
+      int64_t pos = fill[recv_pairs[2 * e + 1] - col0]++;
+      t->col_idx[pos] = recv_pairs[2 * e];
+      char *value = (char *) t->values + pos * esz;
+      memcpy(value, recv_values + e * esz, esz);
+      if (conj) {
+        dtype_conj(a->dt, value);
+      }
+    }
+  } else {
+    sparse_free(t);
+  }
+
+  MPI_Type_free(&pair_type);
+  free(fill);
+  free(next);
+  free(send_pairs);
+  free(recv_pairs);
+  free(send_values);
+  free(recv_values);
+  free(send_counts);
+  free(recv_counts);
+  free(send_displs);
+  free(recv_displs);
+  return ok;
+}
+
+// Scatter the bands of rows of the matrix held by the root. `local` gets the band of the rank,
+// starting at row `row0` of the matrix of `total_rows` rows. Returns false on every rank if a
+// band cannot be allocated or exchanged.
+bool scatter_bands(const SparseMatrix *global, SparseMatrix *local, DType dt, int *row0, int *total_rows,
+                   MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  int shape[2];
+  if (rank == 0) {
+    shape[0] = global->rows;
+    shape[1] = global->cols;
+  }
+  MPI_Bcast(shape, 2, MPI_INT, 0, comm);
+  *row0 = band_first(shape[0], rank, size);
+  *total_rows = shape[0];
+  int rows = band_first(shape[0], rank + 1, size) - *row0;
+
+  // Row pointers first, overlapping by one row between bands, to size the band
+  int *counts = malloc(size * sizeof(int)), *displs = malloc(size * sizeof(int));
+  for (int p = 0; p < size; p++) {
+    displs[p] = band_first(shape[0], p, size);
+    counts[p] = band_first(shape[0], p + 1, size) - displs[p] + 1;
+  }
+  int64_t *row_ptr = malloc(((size_t) rows + 1) * sizeof(int64_t));
+  MPI_Scatterv(rank == 0 ? global->row_ptr : NULL, counts, displs, MPI_INT64_T, row_ptr, rows + 1, MPI_INT64_T, 0,
+               comm);
+  bool ok = sparse_alloc(local, rows, shape[1], row_ptr[rows] - row_ptr[0], dt);
+  if (ok) {
+    for (int i = 0; i <= rows; i++) {
+      local->row_ptr[i] = row_ptr[i] - row_ptr[0];
+    }
+  } else {
+    printf("Error: rank %d cannot allocate its band of %lld elements\n", rank, (long long) (row_ptr[rows] - row_ptr[0]));
+  }
+  free(row_ptr);
+  free(counts);
+  free(displs);
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_C_BOOL, MPI_LAND, comm);
+  if (!ok) {
+    sparse_free(local);
+    return false;
+  }
+
+  int64_t *nnz_counts = malloc(size * sizeof(int64_t)), *nnz_displs = malloc(size * sizeof(int64_t));
+  if (rank == 0) {
+    for (int p = 0; p < size; p++) {
+      int first = band_first(shape[0], p, size), last = band_first(shape[0], p + 1, size);
+      nnz_displs[p] = global->row_ptr[first];
+      nnz_counts[p] = global->row_ptr[last] - global->row_ptr[first];
+    }
+  }
+  MPI_Datatype type = dtype_mpi_type(dt);
+  ok = scatterv_large(rank == 0 ? global->col_idx : NULL, nnz_counts, nnz_displs, local->col_idx, local->nnz, MPI_INT,
+                      0, comm) &&
+       scatterv_large(rank == 0 ? global->values : NULL, nnz_counts, nnz_displs, local->values, local->nnz, type, 0,
+                      comm);
+  free(nnz_counts);
+  free(nnz_displs);
+  if (!ok) {
+    sparse_free(local);
+  }
+  return ok;
+}
+
+// Gather the bands of rows of a distributed matrix with `rows` x `cols` elements into `global`,
+// which is allocated on the root. Returns false on every rank if it cannot be allocated or
+// gathered.
+bool gather_bands(const SparseMatrix *local, SparseMatrix *global, int rows, int cols, MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  int64_t *nnz = malloc(size * sizeof(int64_t)), *nnz_displs = malloc(size * sizeof(int64_t));
+  int *counts = malloc(size * sizeof(int)), *displs = malloc(size * sizeof(int));
+  MPI_Gather(&local->nnz, 1, MPI_INT64_T, nnz, 1, MPI_INT64_T, 0, comm);
+  bool ok = true;
+  if (rank == 0) {
+    int64_t total = 0;
+    for (int p = 0; p < size; p++) {
+      nnz_displs[p] = total;
+      total += nnz[p];
+    }
+    ok = sparse_alloc(global, rows, cols, total, local->dt);
+    if (!ok) {
+      printf("Error: cannot allocate the gathered matrix of %lld elements\n", (long long) total);
+    }
+  }
+  MPI_Bcast(&ok, 1, MPI_C_BOOL, 0, comm);
+  if (ok && rank == 0) {
+    global->row_ptr[0] = 0;
+    for (int p = 0; p < size; p++) {
+      displs[p] = band_first(rows, p, size) + 1;
+      counts[p] = band_first(rows, p + 1, size) + 1 - displs[p];
+    }
+  }
+  if (ok) {
+    // Row pointers without the leading zero of every band, shifted by the preceding bands below
+    MPI_Gatherv(local->row_ptr + 1, local->rows, MPI_INT64_T, rank == 0 ? global->row_ptr : NULL, counts, displs,
+                MPI_INT64_T, 0, comm);
+    if (rank == 0) {
+      for (int p = 0; p < size; p++) {
+        for (int i = displs[p]; i < displs[p] + counts[p]; i++) {
+          global->row_ptr[i] += nnz_displs[p];
+        }
+      }
+    }
+    MPI_Datatype type = dtype_mpi_type(local->dt);
+    ok = gatherv_large(local->col_idx, local->nnz, rank == 0 ? global->col_idx : NULL, nnz, nnz_displs, MPI_INT, 0,
+                       comm) &&
+         gatherv_large(local->values, local->nnz, rank == 0 ? global->values : NULL, nnz, nnz_displs, type, 0, comm);
+    if (!ok && rank == 0) {
+      sparse_free(global);
+    }
+  }
+  free(nnz);
+  free(nnz_displs);
+  free(counts);
+  free(displs);
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+
+  MPI_Init(&argc, &argv);
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  bool check, verbose, conj;
+  Timer transpose_timer;
+  DType dt;
+
+  parse_dtype_args(&argc, argv, &dt, &conj);
+  bool generated = parse_sparse_args(argc, argv, &check, &verbose);
+
+  // Only the root holds the whole matrix, which it distributes by bands of rows
+  SparseMatrix a = {0}, local, local_t;
+  int ok = 1;
+  if (rank == 0) {
+    if (generated) {
+      ok = sparse_generate(&a, atoi(argv[1]), atoi(argv[2]), atof(argv[3]), dt, time(NULL));
+      if (!ok) {
+        printf("Error: invalid size or density (between 0 and 1)\n");
+      }
+    } else {
+      ok = sparse_load_mtx(argv[1], dt, &a);
+    }
+  }
+  MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (!ok) {
+    MPI_Finalize();
+    return 1;
+  }
+  int row0, total_rows;
+  if (!scatter_bands(&a, &local, dt, &row0, &total_rows, MPI_COMM_WORLD)) {
+    sparse_free(&a);
+    MPI_Finalize();
+    return 1;
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  transpose_timer.start = MPI_Wtime();
+  ok = sparse_transpose_mpi(&local, row0, total_rows, &local_t, conj, MPI_COMM_WORLD);
+  transpose_timer.end = MPI_Wtime();
+  if (!ok) {
+    sparse_free(&a);
+    sparse_free(&local);
+    MPI_Finalize();
+    return 1;
+  }
+
+  bool gathered = true;
+  if (check || verbose) {
+    SparseMatrix t = {0};
+    gathered = gather_bands(&local_t, &t, local.cols, total_rows, MPI_COMM_WORLD);
+    if (gathered && rank == 0) {
+      if (verbose) {
+        print_sparse(&a);
+        print_sparse(&t);
+      }
+      if (check) {
+        check_sparse_transpose(&a, &t, conj);
+      }
+      sparse_free(&t);
+    }
+  }
+  if (rank == 0) {
+    printf("threads: %d, transpose_time: %f, nnz: %lld\n", size, get_time(transpose_timer), (long long) a.nnz);
+    sparse_free(&a);
+  }
+  sparse_free(&local);
+  sparse_free(&local_t);
+  MPI_Finalize();
+  return gathered ? 0 : 1;
+}
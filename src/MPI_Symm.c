@@ -4,16 +4,19 @@
 #include <time.h>
 #include <stdbool.h>
 #include "utils.h"
+#include "mpi_utils.h"
+#include "kernels.h"
 
 /// Check if the matrix is symmetric. Each process checks a subset of the rows.
-void check_sym(int N, float** mat, int rank, int size, int* ret) {
+void check_sym(int N, DType dt, char** mat, int rank, int size, int* ret) {
+  size_t esz = dtype_size(dt);
   int remainder = N % size;
   int start = rank * N / size + (rank < remainder ? rank : remainder);
   int end = start + N / size + (rank < remainder ? 1 : 0);
   int is_sym = 1;
   for (int i = start; i < end; ++i) {
     for (int j = 0; j < N; ++j) {
-      if (mat[i][j] != mat[j][i]) {
+      if (!dtype_equal(dt, ELEM(mat, i, j, esz), ELEM(mat, j, i, esz), false)) {
         is_sym = 0;
         break;
       }
@@ -22,22 +25,20 @@ void check_sym(int N, float** mat, int rank, int size, int* ret) {
   MPI_Reduce(&is_sym, ret, 1, MPI_INT, MPI_LAND, 0, MPI_COMM_WORLD);
 }
 
-void transpose(int N, float** mat, float** mat_t, int rank, int size) {
+void transpose(int N, DType dt, bool conj, char** mat, char** mat_t, int rank, int size) {
+  MPI_Datatype elem_type = dtype_mpi_type(dt);
+  size_t esz = dtype_size(dt);
   int remainder = N % size;
   int start = rank * N / size + (rank < remainder ? rank : remainder);
   int end = start + N / size + (rank < remainder ? 1 : 0);
   
-  for (int i = start; i < end; i++) {
-    for (int j = 0; j < N; ++j) {
-      mat_t[j][i] = mat[i][j];
-    }
-  }
+  transpose_block(dt, conj, ELEM(mat, start, 0, esz), N, ELEM(mat_t, 0, start, esz), N, end - start, N);
   
   MPI_Datatype block_type, new_block_type;
-  MPI_Type_vector(N, 1, N, MPI_FLOAT, &block_type);
+  MPI_Type_vector(N, 1, N, elem_type, &block_type);
   MPI_Type_commit(&block_type);
 
-  MPI_Type_create_resized(block_type, 0, 1*sizeof(float), &new_block_type);
+  MPI_Type_create_resized(block_type, 0, 1*esz, &new_block_type);
   MPI_Type_commit(&new_block_type);
 
   if (rank == 0) {
@@ -50,7 +51,7 @@ void transpose(int N, float** mat, float** mat_t, int rank, int size) {
 
     MPI_Gatherv(MPI_IN_PLACE, end-start, new_block_type, mat_t[0], count, disp, new_block_type, 0, MPI_COMM_WORLD);
   } else {
-    MPI_Gatherv(&(mat_t[0][start]), end-start, new_block_type, NULL, 0, NULL, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(ELEM(mat_t, 0, start, esz), end-start, new_block_type, NULL, 0, NULL, elem_type, 0, MPI_COMM_WORLD);
   }
   MPI_Type_free(&block_type);
   MPI_Type_free(&new_block_type);
@@ -63,14 +64,17 @@ int main(int argc, char *argv[]) {
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   
-  float **mat;
+  char **mat;
   bool verbose = false;
   bool symmetric = false;
   int is_sym = 0;
   Timer sym_timer;
+  DType dt;
+  bool conj;
 
+  parse_dtype_args(&argc, argv, &dt, &conj);
   if (argc < 2 || argc >= 5) {
-    printf("Usage: %s <matrix_dim> [<verbose>] [<symmetric>]\n", argv[0]);
+    printf("Usage: %s <matrix_dim> [<verbose>] [<symmetric>] [--dtype <type>]\n", argv[0]);
     return 1;
   } else {
     if (argc >= 3 && strcmp(argv[3], "verbose") == 0) {
@@ -83,22 +87,22 @@ int main(int argc, char *argv[]) {
   int N = atoi(argv[1]);
   srand(time(NULL));
   
-  init_matrix(N, N, &mat);
+  init_matrix(N, N, dtype_size(dt), &mat);
   
   if (rank == 0) {
     if (symmetric) {
-      fill_sym_matrix(N, &mat);
+      fill_sym_matrix(N, dt, &mat);
     } else {
-      fill_rand_matrix(N, &mat);
+      fill_rand_matrix(N, dt, &mat);
     }
     if (verbose) {
-      print_matrix(N, mat);
+      print_matrix(N, dt, mat);
     }
   }
 
   sym_timer.start = MPI_Wtime();
-  MPI_Bcast(mat[0], N*N, MPI_FLOAT, 0, MPI_COMM_WORLD);
-  check_sym(N, mat, rank, size, &is_sym);
+  bcast_large(mat[0], (size_t) N * N, dtype_mpi_type(dt), 0, MPI_COMM_WORLD);
+  check_sym(N, dt, mat, rank, size, &is_sym);
   sym_timer.end = MPI_Wtime();
   
   if (rank == 0) {
@@ -3,96 +3,99 @@
 #include <time.h>
 #include <omp.h>
 #include "utils.h"
+#include "kernels.h"
+#include "transpose.h"
 
-#define BLOCK_SIZE 64
-
-void init_rand(float **m, int size) {
-    #pragma omp parallel for simd
-    for (int i = 0; i < size; i++) {
-        for (int j = 0; j < size; j++) {
-            m[i][j] = (float)rand();
-        }
-    }
-}
-
-void print_mat(float **m, int size) {
-    for (int i = 0; i < size; i++) {
-        for (int j = 0; j < size; j++) {
-            printf("%12.0f ", m[i][j]);
-        }
-        printf("\n");
-    }
-}
-
-int check_sym(float **m, int size) {
-    int is_sym = 1;
-    #pragma omp parallel for simd reduction(&:is_sym)
-    for (int i = 0; i < size; i++) {
-        for (int j = 0; j < i; j++) {
-            if (m[i][j] != m[j][i]) {
-                is_sym &= 0;
-            }
-        }
-    }
-    return is_sym;
-}
-
-void blocked_transpose(float **m, float **t, int i1, int i2, int j1, int j2, int size) {
-    // Test for overflows
-    i2 = (i2 < size) ? i2 : size;
-    j2 = (j2 < size) ? j2 : size;
-    // Perform matrix transposition on the block
-    for (int i = i1; i < i2; i++) {
-        #pragma omp simd
-        for (int j = j1; j < j2; j++) {
-            t[i][j] = m[j][i];
-        }
-    }
-}
-
-// Divide the matrix into blocks and transpose each block
-void divide_transpose(float **m, float **t, int size) {
-    #pragma omp parallel for
-    for (int i = 0; i < size; i += BLOCK_SIZE) {
-        for (int j = 0; j < size; j += BLOCK_SIZE) {
-            blocked_transpose(m, t, i, i + BLOCK_SIZE, j, j + BLOCK_SIZE, size);
-        }
+// Tile schedule selected by --sched: static row-major (default), tasks, or static along a
+// Morton or Hilbert curve
+unsigned parse_schedule(const char *name) {
+    if (name == NULL || strcmp(name, "static") == 0) {
+        return 0;
+    } else if (strcmp(name, "tasks") == 0) {
+        return TRANSPOSE_TASKS;
+    } else if (strcmp(name, "morton") == 0) {
+        return TRANSPOSE_ORDER_MORTON;
+    } else if (strcmp(name, "hilbert") == 0) {
+        return TRANSPOSE_ORDER_HILBERT;
     }
+    printf("Error: unknown schedule %s (static, tasks, morton, hilbert)\n", name);
+    exit(1);
 }
 
 int main(int argc, char **argv) {
-    bool check, verbose;
+    bool check, verbose, conj;
     int N;
+    DType dt;
 
+    parse_dtype_args(&argc, argv, &dt, &conj);
+    // Time the candidate tile sizes when planning instead of using the default for the width
+    bool measure = take_option(&argc, argv, "--measure", false) != NULL;
+    unsigned schedule = parse_schedule(take_option(&argc, argv, "--sched", true));
+    // Store the matrices by tiles, in the order of the schedule, so that the transpose only moves
+    // contiguous tiles
+    bool tiled = take_option(&argc, argv, "--tiled", false) != NULL;
     parse_args(argc, argv, &N, &check, &verbose);
     srand(time(NULL));
     
     // Allocate memory for the matrices
-    float **m = (float **)malloc(N * sizeof(float *));
-    float **t = (float **)malloc(N * sizeof(float *));
-    for (int i = 0; i < N; i++) {
-        m[i] = (float *)malloc(N * sizeof(float));
-        t[i] = (float *)malloc(N * sizeof(float));
-    }
+    char **m, **t;
+    init_matrix(N, N, dtype_size(dt), &m);
+    init_matrix(N, N, dtype_size(dt), &t);
     
-    init_rand(m, N);
-    
-    double start, end;
+    fill_rand_matrix(N, dt, &m);
+
+    // Divide the matrix into tiles shared among the threads. Unless measured, the tile size
+    // shrinks with the thread count so that small matrices keep all the threads busy
+    unsigned flags = schedule | (conj ? TRANSPOSE_CONJ : 0) | (measure ? TRANSPOSE_MEASURE : 0);
+    TransposePlan *plan;
+    TransposeLayout *layout = NULL;
+    char *src = m[0], *dst = t[0];
+    double start, end, pack_time = 0, unpack_time = 0;
+    if (tiled) {
+        // The layout of the transpose of a square matrix is the same
+        layout = transpose_layout_create(N, N, default_tile_size(dt), schedule);
+        src = (char *) malloc(transpose_layout_size(layout) * dtype_size(dt));
+        dst = (char *) malloc(transpose_layout_size(layout) * dtype_size(dt));
+        memset(dst, 0, transpose_layout_size(layout) * dtype_size(dt));
+        start = omp_get_wtime();
+        transpose_layout_pack(layout, dt, m[0], 0, src, 0);
+        pack_time = omp_get_wtime() - start;
+        plan = transpose_plan_tiled(layout, layout, dt, 0, flags);
+    } else {
+        plan = transpose_plan_create(N, N, 0, 0, dt, 0, 0, flags);
+    }
 
     // Compute blocked transpose
     start = omp_get_wtime();
-    divide_transpose(m, t, N);
+    transpose_execute(plan, src, dst);
     end = omp_get_wtime();
 
+    if (tiled) {
+        double unpack_start = omp_get_wtime();
+        transpose_layout_unpack(layout, dt, dst, t[0], 0, 0);
+        unpack_time = omp_get_wtime() - unpack_start;
+    }
+
     // Print wall time
     if (verbose) {
-        printf("Time taken for matrix transposition: %.9fs\n", end-start);
+        printf("Time taken for matrix transposition: %.9fs (tile %d)\n", end-start, transpose_plan_tile(plan));
         printf("- Input matrix -\n");
-        print_mat(m, N);
+        print_matrix(N, dt, m);
         printf("- Transposed matrix -\n");
-        print_mat(t, N);
+        print_matrix(N, dt, t);
+    } else if (tiled) {
+        printf("threads: %d, transpose_time: %f, pack_time: %f, unpack_time: %f\n", omp_get_max_threads(), end-start, pack_time, unpack_time);
     } else {
         printf("threads: %d, transpose_time: %f\n", omp_get_max_threads(), end-start);
     }
+    if (check) {
+        check_correctness(N, dt, conj, m, t);
+    }
+    transpose_plan_destroy(plan);
+    transpose_layout_destroy(layout);
+    if (tiled) {
+        free(src);
+        free(dst);
+    }
     return 0;
 }
@@ -0,0 +1,317 @@
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#include "utils.h"
+#include "pipeline.h"
+#include "kernels.h"
+
+// Number of buffer slots in flight: one being read, one being transposed, one being written
+#define NUM_SLOTS 3
+#define DEFAULT_BUDGET_MB 1024
+
+// Region of the input matrix held by a buffer slot
+typedef struct {
+  char *in;
+  char *out;
+  int r0, c0;
+  int h, w;
+} Slot;
+
+typedef struct {
+  int fd_in, fd_out;
+  int rows, cols;
+  DType dt;
+  bool conj;
+  size_t esz;
+  int tile;
+  // Geometry of the regions streamed through the pipeline
+  int band_h, band_w;
+  Slot slots[NUM_SLOTS];
+  SlotQueue free_slots, loaded, transposed;
+  double read_busy, compute_busy, write_busy;
+} OutOfCore;
+
+/// Read or write exactly `len` bytes at `offset`, retrying on short transfers.
+void full_pio(int fd, void *buf, size_t len, off_t offset, bool write) {
+  char *ptr = (char *) buf;
+  while (len > 0) {
+    ssize_t ret = write ? pwrite(fd, ptr, len, offset) : pread(fd, ptr, len, offset);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0) {
+      fprintf(stderr, "Error: %s failed: %s\n", write ? "pwrite" : "pread", ret < 0 ? strerror(errno) : "unexpected end of file");
+      exit(1);
+    }
+    ptr += ret;
+    len -= ret;
+    offset += ret;
+  }
+}
+
+// Transpose the h x w region `in` (row stride w) into the w x h region `out` (row stride h)
+void transpose_band(OutOfCore *ooc, const char *in, char *out, int h, int w) {
+  int tile = ooc->tile;
+  size_t esz = ooc->esz;
+  #pragma omp parallel for collapse(2) schedule(static)
+  for (int i = 0; i < h; i += tile) {
+    for (int j = 0; j < w; j += tile) {
+      int iend = (i + tile < h) ? i + tile : h;
+      int jend = (j + tile < w) ? j + tile : w;
+      transpose_block(ooc->dt, ooc->conj, in + ((size_t) i * w + j) * esz, w,
+                      out + ((size_t) j * h + i) * esz, h, iend - i, jend - j);
+    }
+  }
+}
+
+/// Choose the size of the regions streamed through the pipeline so that NUM_SLOTS input and
+/// output buffers fit in the budget. A region of h x w elements is read as h runs of w elements
+/// and written as w runs of h elements, so the shorter of the two sides bounds the length of
+/// every transfer: it is made as long as the budget allows, with square panels of side
+/// sqrt(budget) unless one side of the matrix is shorter. When every column fits, regions are
+/// whole-row bands read with a single pread; when every row fits, whole-column bands whose
+/// transpose is written with a single pwrite.
+void choose_geometry(OutOfCore *ooc, size_t budget) {
+  size_t elems = budget / (NUM_SLOTS * 2 * ooc->esz);
+  size_t tile = ooc->tile;
+  size_t side = 1;
+  while ((side + 1) * (side + 1) <= elems) side++;
+  side = side > tile ? side / tile * tile : side;
+  size_t h, w;
+  if ((size_t) ooc->cols <= side) {
+    w = ooc->cols;
+    h = elems / w;
+    h = h > tile ? h / tile * tile : h;
+  } else if ((size_t) ooc->rows <= side) {
+    h = ooc->rows;
+    w = elems / h;
+    w = w > tile ? w / tile * tile : w;
+  } else {
+    h = w = side;
+  }
+  ooc->band_h = (int) (h < (size_t) ooc->rows ? h : (size_t) ooc->rows);
+  ooc->band_w = (int) (w < (size_t) ooc->cols ? w : (size_t) ooc->cols);
+}
+
+// Read the input regions in row-major order and hand them to the compute stage
+void *reader_stage(void *arg) {
+  OutOfCore *ooc = (OutOfCore *) arg;
+  for (int r0 = 0; r0 < ooc->rows; r0 += ooc->band_h) {
+    for (int c0 = 0; c0 < ooc->cols; c0 += ooc->band_w) {
+      int s = queue_pop(&ooc->free_slots);
+      double start = omp_get_wtime();
+      Slot *slot = &ooc->slots[s];
+      slot->r0 = r0;
+      slot->c0 = c0;
+      slot->h = (r0 + ooc->band_h < ooc->rows) ? ooc->band_h : ooc->rows - r0;
+      slot->w = (c0 + ooc->band_w < ooc->cols) ? ooc->band_w : ooc->cols - c0;
+      if (slot->w == ooc->cols) {
+        full_pio(ooc->fd_in, slot->in, (size_t) slot->h * slot->w * ooc->esz,
+                 (off_t) r0 * ooc->cols * ooc->esz, false);
+      } else {
+        for (int i = 0; i < slot->h; i++) {
+          full_pio(ooc->fd_in, slot->in + (size_t) i * slot->w * ooc->esz, (size_t) slot->w * ooc->esz,
+                   ((off_t) (r0 + i) * ooc->cols + c0) * ooc->esz, false);
+        }
+      }
+      ooc->read_busy += omp_get_wtime() - start;
+      queue_push(&ooc->loaded, s);
+    }
+  }
+  queue_push(&ooc->loaded, END_OF_STREAM);
+  return NULL;
+}
+
+// Write every transposed region to its final position and give the slot back to the reader.
+// Each row of the transposed region is a contiguous run of h elements in the output file, and
+// the whole region is one run when it spans every row of the input.
+void *writer_stage(void *arg) {
+  OutOfCore *ooc = (OutOfCore *) arg;
+  int s;
+  while ((s = queue_pop(&ooc->transposed)) != END_OF_STREAM) {
+    double start = omp_get_wtime();
+    Slot *slot = &ooc->slots[s];
+    if (slot->h == ooc->rows) {
+      full_pio(ooc->fd_out, slot->out, (size_t) slot->h * slot->w * ooc->esz,
+               (off_t) slot->c0 * ooc->rows * ooc->esz, true);
+    } else {
+      for (int j = 0; j < slot->w; j++) {
+        full_pio(ooc->fd_out, slot->out + (size_t) j * slot->h * ooc->esz, (size_t) slot->h * ooc->esz,
+                 ((off_t) (slot->c0 + j) * ooc->rows + slot->r0) * ooc->esz, true);
+      }
+    }
+    ooc->write_busy += omp_get_wtime() - start;
+    queue_push(&ooc->free_slots, s);
+  }
+  return NULL;
+}
+
+/// Transpose the rows x cols matrix stored in `fd_in` into `fd_out`, keeping at most `budget`
+/// bytes of matrix data in memory. Reading, transposing and writing run in separate stages
+/// connected by queues, so the I/O of neighbouring regions overlaps the transposition.
+void out_of_core_transpose(OutOfCore *ooc, size_t budget) {
+  ooc->esz = dtype_size(ooc->dt);
+  ooc->tile = default_tile_size(ooc->dt);
+  choose_geometry(ooc, budget);
+  size_t slot_bytes = ((size_t) ooc->band_h * ooc->band_w * ooc->esz + 63) / 64 * 64;
+  queue_init(&ooc->free_slots, NUM_SLOTS + 1);
+  queue_init(&ooc->loaded, NUM_SLOTS + 1);
+  queue_init(&ooc->transposed, NUM_SLOTS + 1);
+  for (int s = 0; s < NUM_SLOTS; s++) {
+    ooc->slots[s].in = (char *) aligned_alloc(64, slot_bytes);
+    ooc->slots[s].out = (char *) aligned_alloc(64, slot_bytes);
+    if (ooc->slots[s].in == NULL || ooc->slots[s].out == NULL) {
+      fprintf(stderr, "Error: cannot allocate pipeline buffers\n");
+      exit(1);
+    }
+    queue_push(&ooc->free_slots, s);
+  }
+  ooc->read_busy = ooc->compute_busy = ooc->write_busy = 0;
+
+  pthread_t reader, writer;
+  pthread_create(&reader, NULL, reader_stage, ooc);
+  pthread_create(&writer, NULL, writer_stage, ooc);
+
+  int s;
+  while ((s = queue_pop(&ooc->loaded)) != END_OF_STREAM) {
+    double start = omp_get_wtime();
+    Slot *slot = &ooc->slots[s];
+    transpose_band(ooc, slot->in, slot->out, slot->h, slot->w);
+    ooc->compute_busy += omp_get_wtime() - start;
+    queue_push(&ooc->transposed, s);
+  }
+  queue_push(&ooc->transposed, END_OF_STREAM);
+
+  pthread_join(reader, NULL);
+  pthread_join(writer, NULL);
+  for (int s = 0; s < NUM_SLOTS; s++) {
+    free(ooc->slots[s].in);
+    free(ooc->slots[s].out);
+  }
+  queue_destroy(&ooc->free_slots);
+  queue_destroy(&ooc->loaded);
+  queue_destroy(&ooc->transposed);
+}
+
+/// Write a rows x cols matrix of generated values to `path`, one row at a time.
+void generate_matrix(const char *path, DType dt, int rows, int cols) {
+  size_t esz = dtype_size(dt);
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+  char *row = (char *) malloc((size_t) cols * esz);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      set_gen_value(dt, row + (size_t) j * esz, i, j, cols);
+    }
+    full_pio(fd, row, (size_t) cols * esz, (off_t) i * cols * esz, true);
+  }
+  free(row);
+  close(fd);
+}
+
+/// Check a transposed generated matrix one output row at a time.
+bool check_output(int fd, DType dt, bool conj, int rows, int cols) {
+  size_t esz = dtype_size(dt);
+  bool correct = true;
+  char *row = (char *) malloc((size_t) rows * esz);
+  for (int j = 0; j < cols && correct; j++) {
+    full_pio(fd, row, (size_t) rows * esz, (off_t) j * rows * esz, false);
+    for (int i = 0; i < rows; i++) {
+      char expected[16];
+      set_gen_value(dt, expected, i, j, cols);
+      if (!dtype_equal(dt, expected, row + (size_t) i * esz, conj)) {
+        printf("Error: mat_t[%d][%d] = ", j, i);
+        dtype_print(dt, row + (size_t) i * esz);
+        printf(", expected ");
+        dtype_print(dt, expected);
+        printf("\n");
+        correct = false;
+        break;
+      }
+    }
+  }
+  if (correct) {
+    printf("Matrix transpose is correct\n");
+  }
+  free(row);
+  return correct;
+}
+
+int main(int argc, char **argv) {
+  OutOfCore ooc;
+  parse_dtype_args(&argc, argv, &ooc.dt, &ooc.conj);
+  if (argc == 5 && strcmp(argv[1], "generate") == 0) {
+    generate_matrix(argv[4], ooc.dt, atoi(argv[2]), atoi(argv[3]));
+    return 0;
+  }
+  if (argc < 5 || argc >= 9) {
+    printf("Usage: %s <rows> <cols> <input_file> <output_file> [<budget_MB>] [<check_correctness>] [<verbose>] [--dtype <type>] [--conj]\n", argv[0]);
+    printf("       %s generate <rows> <cols> <output_file> [--dtype <type>]\n", argv[0]);
+    return 1;
+  }
+
+  ooc.rows = atoi(argv[1]);
+  ooc.cols = atoi(argv[2]);
+  long budget_mb = argc >= 6 ? atol(argv[5]) : DEFAULT_BUDGET_MB;
+  bool check = argc >= 7 && strcmp(argv[6], "check") == 0;
+  bool verbose = argc >= 8 && strcmp(argv[7], "verbose") == 0;
+  if (ooc.rows <= 0 || ooc.cols <= 0 || budget_mb <= 0) {
+    printf("Error: rows, cols and budget_MB must be positive integers\n");
+    return 1;
+  }
+  size_t budget = (size_t) budget_mb << 20;
+
+  ooc.fd_in = open(argv[3], O_RDONLY);
+  ooc.fd_out = open(argv[4], O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (ooc.fd_in < 0 || ooc.fd_out < 0) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", ooc.fd_in < 0 ? argv[3] : argv[4], strerror(errno));
+    return 1;
+  }
+  off_t bytes = (off_t) ooc.rows * ooc.cols * dtype_size(ooc.dt);
+  if (lseek(ooc.fd_in, 0, SEEK_END) < bytes) {
+    fprintf(stderr, "Error: %s is smaller than a %d x %d matrix\n", argv[3], ooc.rows, ooc.cols);
+    return 1;
+  }
+  // Input is read front to back; the output is allocated up front so that the regions can be
+  // written in any order
+  posix_fadvise(ooc.fd_in, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if (ftruncate(ooc.fd_out, bytes) != 0) {
+    fprintf(stderr, "Error: cannot resize %s: %s\n", argv[4], strerror(errno));
+    return 1;
+  }
+
+  Timer transpose_timer;
+  transpose_timer.start = omp_get_wtime();
+  out_of_core_transpose(&ooc, budget);
+  fsync(ooc.fd_out);
+  transpose_timer.end = omp_get_wtime();
+
+  if (check) {
+    check_output(ooc.fd_out, ooc.dt, ooc.conj, ooc.rows, ooc.cols);
+  }
+  if (verbose) {
+    // Transfers are whole regions when they span the matrix, one run per row or column otherwise
+    size_t read_run = (size_t) ooc.band_w * ooc.esz, write_run = (size_t) ooc.band_h * ooc.esz;
+    read_run *= ooc.band_w == ooc.cols ? ooc.band_h : 1;
+    write_run *= ooc.band_h == ooc.rows ? ooc.band_w : 1;
+    printf("Region size: %d x %d, slots: %d\n", ooc.band_h, ooc.band_w, NUM_SLOTS);
+    printf("Read run: %zu bytes, write run: %zu bytes\n", read_run, write_run);
+    printf("Time taken for matrix transposition: %.9fs\n", get_time(transpose_timer));
+    printf("Busy time - read: %.6fs, transpose: %.6fs, write: %.6fs\n", ooc.read_busy, ooc.compute_busy, ooc.write_busy);
+    printf("Throughput: %.2f MB/s\n", 2.0 * bytes / get_time(transpose_timer) / (1 << 20));
+  } else {
+    printf("threads: %d, transpose_time: %f, read_time: %f, compute_time: %f, write_time: %f\n",
+           omp_get_max_threads(), get_time(transpose_timer), ooc.read_busy, ooc.compute_busy, ooc.write_busy);
+  }
+
+  close(ooc.fd_in);
+  close(ooc.fd_out);
+  return 0;
+}
@@ -3,69 +3,31 @@
 #include <stdlib.h>
 #include <time.h>
 #include "utils.h"
-
-void init_rand(float **m, int size) {
-    for (int i = 0; i < size; i++) {
-        for (int j = 0; j < size; j++) {
-            m[i][j] = (float)rand();
-        }
-    }
-}
-
-void print_mat(float **m, int size) {
-    for (int i = 0; i < size; i++) {
-        for (int j = 0; j < size; j++) {
-            printf("%12.0f ", m[i][j]);
-        }
-        printf("\n");
-    }
-}
-
-int check_sym(float **m, int size) {
-    int is_sym = 1;
-    for (int i = 0; i < size; i++) {
-        for (int j = 0; j < i; j++) {
-            if (m[i][j] != m[j][i]) {
-                is_sym = 0;
-            }
-        }
-    }
-    return is_sym;
-}
-
-void transpose(float **m, float **t, int size) {
-    for (int i = 0; i < size; i++) {
-        // gcc thinks that this loop can't be vectorized because of a data dependence
-        // since this is not the case, force gcc to ignore the data dependency check
-        // by adding the ignore vector dependency pragma (ivdep)
-        #pragma GCC ivdep
-        for (int j = 0; j < size; j++) {
-            t[i][j] = m[j][i];
-        }
-    }
-}
+#include "transpose.h"
 
 int main(int argc, char **argv) {
-    bool check, verbose;
+    bool check, verbose, conj;
     int N;
+    DType dt;
 
+    parse_dtype_args(&argc, argv, &dt, &conj);
     parse_args(argc, argv, &N, &check, &verbose);
     srand(time(NULL));
 
     // Allocate memory for the matrices
-    float **m = (float **)malloc(N * sizeof(float *));
-    float **t = (float **)malloc(N * sizeof(float *));
-    for (int i = 0; i < N; i++) {
-        m[i] = (float *)malloc(N * sizeof(float));
-        t[i] = (float *)malloc(N * sizeof(float));
-    }
+    char **m, **t;
+    init_matrix(N, N, dtype_size(dt), &m);
+    init_matrix(N, N, dtype_size(dt), &t);
+
+    fill_rand_matrix(N, dt, &m);
 
-    init_rand(m, N);
+    // Sweep the whole matrix with the SIMD micro-kernel for the element width, without tiling
+    TransposePlan *plan = transpose_plan_create(N, N, 0, 0, dt, 1, 0, TRANSPOSE_UNTILED | (conj ? TRANSPOSE_CONJ : 0));
     struct timespec start, end;
 
     // Compute transpose
     clock_gettime(CLOCK_MONOTONIC, &start);
-    transpose(m, t, N);
+    transpose_execute(plan, m[0], t[0]);
     clock_gettime(CLOCK_MONOTONIC, &end);
 
     long seconds = end.tv_sec - start.tv_sec;
@@ -76,12 +38,17 @@ int main(int argc, char **argv) {
     if (verbose) {
         printf("Time taken for matrix transposition: %.9fs\n", elapsed);
         printf("- Input matrix -\n");
-        print_mat(m, N);
+        print_matrix(N, dt, m);
         printf("- Transposed matrix -\n");
-        print_mat(t, N);
+        print_matrix(N, dt, t);
     } else {
         printf("transpose_time: %f\n", elapsed);
     }
 
+    if (check) {
+        check_correctness(N, dt, conj, m, t);
+    }
+
+    transpose_plan_destroy(plan);
     return 0;
 }
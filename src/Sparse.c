@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <omp.h>
+#include "utils.h"
+#include "sparse.h"
+
+int main(int argc, char **argv) {
+    bool check, verbose, conj;
+    DType dt;
+
+    parse_dtype_args(&argc, argv, &dt, &conj);
+    if (argc == 6 && strcmp(argv[1], "generate") == 0) {
+        SparseMatrix m;
+        if (!sparse_generate(&m, atoi(argv[2]), atoi(argv[3]), atof(argv[4]), dt, time(NULL))) {
+            printf("Error: invalid size or density (between 0 and 1)\n");
+            return 1;
+        }
+        bool saved = sparse_save_mtx(argv[5], &m);
+        sparse_free(&m);
+        return saved ? 0 : 1;
+    }
+
+    bool generated = parse_sparse_args(argc, argv, &check, &verbose);
+
+    SparseMatrix a, t;
+    if (generated) {
+        if (!sparse_generate(&a, atoi(argv[1]), atoi(argv[2]), atof(argv[3]), dt, time(NULL))) {
+            printf("Error: invalid size or density (between 0 and 1)\n");
+            return 1;
+        }
+    } else if (!sparse_load_mtx(argv[1], dt, &a)) {
+        return 1;
+    }
+
+    // Count the columns, prefix-sum the counts and scatter the elements, in parallel
+    double start = omp_get_wtime();
+    if (!sparse_transpose(&a, &t, 0, conj)) {
+        printf("Error: cannot allocate the transpose\n");
+        return 1;
+    }
+    double end = omp_get_wtime();
+
+    if (verbose) {
+        printf("Time taken for matrix transposition: %.9fs\n", end - start);
+        printf("- Input matrix -\n");
+        print_sparse(&a);
+        printf("- Transposed matrix -\n");
+        print_sparse(&t);
+    } else {
+        printf("threads: %d, transpose_time: %f, nnz: %lld\n", omp_get_max_threads(), end - start, (long long) a.nnz);
+    }
+    if (check) {
+        check_sparse_transpose(&a, &t, conj);
+    }
+    sparse_free(&a);
+    sparse_free(&t);
+    return 0;
+}
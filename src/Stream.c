@@ -0,0 +1,307 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#include "utils.h"
+#include "pipeline.h"
+#include "transpose.h"
+
+// Buffers in flight by default: one being read, one being transposed, one being written and a
+// spare absorbing jitter of the input
+#define DEFAULT_SLOTS 4
+
+// A matrix of the stream held by a buffer slot
+typedef struct {
+  char *in;
+  char *out;
+  long index;
+  // Time at which the matrix was completely read
+  double ingested;
+} Slot;
+
+typedef struct {
+  int fd_in, fd_out;
+  int rows, cols;
+  DType dt;
+  bool conj;
+  bool check;
+  size_t bytes;
+  int num_slots;
+  Slot *slots;
+  SlotQueue free_slots, loaded, transposed;
+  TransposePlan *plan;
+  // Statistics: matrices written, latency from ingestion to output of each of them, and
+  // matrices failing the check
+  long count;
+  double *latencies;
+  long latencies_cap;
+  long errors;
+  bool truncated;
+  double read_busy, compute_busy, write_busy;
+} Stream;
+
+/// Read or write exactly `len` bytes, retrying on short transfers as pipes return partial
+/// buffers. Returns the number of bytes transferred, which is less than `len` only when the
+/// input ends.
+size_t full_io(int fd, void *buf, size_t len, bool write_mode) {
+  char *ptr = (char *) buf;
+  size_t done = 0;
+  while (done < len) {
+    ssize_t ret = write_mode ? write(fd, ptr + done, len - done) : read(fd, ptr + done, len - done);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret < 0) {
+      fprintf(stderr, "Error: %s failed: %s\n", write_mode ? "write" : "read", strerror(errno));
+      exit(1);
+    }
+    if (ret == 0) {
+      break;
+    }
+    done += ret;
+  }
+  return done;
+}
+
+// Store the generated value of position (i, j) of matrix k of the stream: the matrices of the
+// stream continue the values of one tall matrix
+void set_stream_value(DType dt, void *elem, long k, int rows, int i, int j, int cols) {
+  dtype_set(dt, elem, gen_value((int64_t) k * rows + i, j, cols), gen_value(j, i, cols));
+}
+
+/// Write `count` generated rows x cols matrices to `fd`.
+void generate_stream(int fd, DType dt, int rows, int cols, long count) {
+  size_t esz = dtype_size(dt);
+  char *row = (char *) malloc((size_t) cols * esz);
+  for (long k = 0; k < count; k++) {
+    for (int i = 0; i < rows; i++) {
+      for (int j = 0; j < cols; j++) {
+        set_stream_value(dt, row + (size_t) j * esz, k, rows, i, j, cols);
+      }
+      full_io(fd, row, (size_t) cols * esz, true);
+    }
+  }
+  free(row);
+}
+
+/// Check the transpose of generated matrix k of the stream. Errors go to stderr, as stdout may
+/// carry the output stream.
+bool check_matrix(const Stream *st, const char *out, long k) {
+  size_t esz = dtype_size(st->dt);
+  for (int j = 0; j < st->cols; j++) {
+    for (int i = 0; i < st->rows; i++) {
+      char expected[16];
+      const char *got = out + ((size_t) j * st->rows + i) * esz;
+      set_stream_value(st->dt, expected, k, st->rows, i, j, st->cols);
+      if (!dtype_equal(st->dt, expected, got, st->conj)) {
+        fprintf(stderr, "Error: element [%d][%d] of transposed matrix %ld is wrong\n", j, i, k);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Read whole matrices until the input ends and hand them to the compute stage
+void *reader_stage(void *arg) {
+  Stream *st = (Stream *) arg;
+  for (long k = 0;; k++) {
+    int s = queue_pop(&st->free_slots);
+    double start = omp_get_wtime();
+    Slot *slot = &st->slots[s];
+    size_t got = full_io(st->fd_in, slot->in, st->bytes, false);
+    if (got < st->bytes) {
+      if (got > 0) {
+        fprintf(stderr, "Error: the input ends in the middle of matrix %ld (%zu of %zu bytes)\n", k, got, st->bytes);
+        st->truncated = true;
+      }
+      queue_push(&st->free_slots, s);
+      break;
+    }
+    slot->index = k;
+    slot->ingested = omp_get_wtime();
+    st->read_busy += slot->ingested - start;
+    queue_push(&st->loaded, s);
+  }
+  queue_push(&st->loaded, END_OF_STREAM);
+  return NULL;
+}
+
+// Write the transposed matrices in order, record their latency and give the slots back
+void *writer_stage(void *arg) {
+  Stream *st = (Stream *) arg;
+  int s;
+  while ((s = queue_pop(&st->transposed)) != END_OF_STREAM) {
+    double start = omp_get_wtime();
+    Slot *slot = &st->slots[s];
+    if (st->check && !check_matrix(st, slot->out, slot->index)) {
+      st->errors++;
+    }
+    full_io(st->fd_out, slot->out, st->bytes, true);
+    double end = omp_get_wtime();
+    st->write_busy += end - start;
+    if (st->count == st->latencies_cap) {
+      st->latencies_cap = st->latencies_cap > 0 ? 2 * st->latencies_cap : 1024;
+      st->latencies = (double *) realloc(st->latencies, st->latencies_cap * sizeof(double));
+    }
+    st->latencies[st->count++] = end - slot->ingested;
+    queue_push(&st->free_slots, s);
+  }
+  return NULL;
+}
+
+/// Transpose every matrix of the input stream into the output stream. The reader, the OpenMP
+/// transpose and the writer are connected by queues of `num_slots` pre-allocated buffers, so
+/// reading matrix k+1 and writing matrix k-1 overlap the transposition of matrix k.
+void run_stream(Stream *st) {
+  st->bytes = (size_t) st->rows * st->cols * dtype_size(st->dt);
+  size_t slot_bytes = (st->bytes + 63) / 64 * 64;
+  st->slots = (Slot *) calloc(st->num_slots, sizeof(Slot));
+  queue_init(&st->free_slots, st->num_slots + 1);
+  queue_init(&st->loaded, st->num_slots + 1);
+  queue_init(&st->transposed, st->num_slots + 1);
+  for (int s = 0; s < st->num_slots; s++) {
+    st->slots[s].in = (char *) aligned_alloc(64, slot_bytes);
+    st->slots[s].out = (char *) aligned_alloc(64, slot_bytes);
+    if (st->slots[s].in == NULL || st->slots[s].out == NULL) {
+      fprintf(stderr, "Error: cannot allocate pipeline buffers\n");
+      exit(1);
+    }
+    // Fault the pages in now rather than on the first matrices
+    memset(st->slots[s].in, 0, slot_bytes);
+    memset(st->slots[s].out, 0, slot_bytes);
+    queue_push(&st->free_slots, s);
+  }
+  st->count = st->errors = 0;
+  st->read_busy = st->compute_busy = st->write_busy = 0;
+
+  pthread_t reader, writer;
+  pthread_create(&reader, NULL, reader_stage, st);
+  pthread_create(&writer, NULL, writer_stage, st);
+
+  int s;
+  while ((s = queue_pop(&st->loaded)) != END_OF_STREAM) {
+    double start = omp_get_wtime();
+    transpose_execute(st->plan, st->slots[s].in, st->slots[s].out);
+    st->compute_busy += omp_get_wtime() - start;
+    queue_push(&st->transposed, s);
+  }
+  queue_push(&st->transposed, END_OF_STREAM);
+
+  pthread_join(reader, NULL);
+  pthread_join(writer, NULL);
+  for (int s = 0; s < st->num_slots; s++) {
+    free(st->slots[s].in);
+    free(st->slots[s].out);
+  }
+  free(st->slots);
+  queue_destroy(&st->free_slots);
+  queue_destroy(&st->loaded);
+  queue_destroy(&st->transposed);
+}
+
+int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/// Latency below which a fraction p of the matrices were output; `sorted` is in ascending order.
+double percentile(const double *sorted, long n, double p) {
+  long k = (long) (p * (n - 1) + 0.5);
+  return sorted[k];
+}
+
+int open_stream(const char *path, bool output) {
+  if (strcmp(path, "-") == 0) {
+    return output ? STDOUT_FILENO : STDIN_FILENO;
+  }
+  int fd = output ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  Stream st;
+  memset(&st, 0, sizeof(st));
+  parse_dtype_args(&argc, argv, &st.dt, &st.conj);
+  if (argc == 6 && strcmp(argv[1], "generate") == 0) {
+    int fd = open_stream(argv[5], true);
+    generate_stream(fd, st.dt, atoi(argv[2]), atoi(argv[3]), atol(argv[4]));
+    close(fd);
+    return 0;
+  }
+  if (argc < 5 || argc >= 9) {
+    printf("Usage: %s <rows> <cols> <input|-> <output|-> [<slots>] [<check_correctness>] [<verbose>] [--dtype <type>] [--conj]\n", argv[0]);
+    printf("       %s generate <rows> <cols> <count> <output|-> [--dtype <type>]\n", argv[0]);
+    return 1;
+  }
+  st.rows = atoi(argv[1]);
+  st.cols = atoi(argv[2]);
+  st.num_slots = argc >= 6 ? atoi(argv[5]) : DEFAULT_SLOTS;
+  st.check = argc >= 7 && strcmp(argv[6], "check") == 0;
+  bool verbose = argc >= 8 && strcmp(argv[7], "verbose") == 0;
+  if (st.rows <= 0 || st.cols <= 0 || st.num_slots < 2) {
+    printf("Error: rows and cols must be positive integers and slots at least 2\n");
+    return 1;
+  }
+  st.fd_in = open_stream(argv[3], false);
+  st.fd_out = open_stream(argv[4], true);
+  // The transposed matrices may go to stdout, the report then goes to stderr
+  FILE *report = st.fd_out == STDOUT_FILENO ? stderr : stdout;
+
+  // The plan is created once and executed for every matrix of the stream
+  st.plan = transpose_plan_create(st.rows, st.cols, 0, 0, st.dt, 0, 0, st.conj ? TRANSPOSE_CONJ : 0);
+  if (st.plan == NULL) {
+    fprintf(stderr, "Error: cannot plan the transpose\n");
+    return 1;
+  }
+  Timer stream_timer;
+  stream_timer.start = omp_get_wtime();
+  run_stream(&st);
+  stream_timer.end = omp_get_wtime();
+  double elapsed = get_time(stream_timer);
+
+  // A checked stream must also hold at least one matrix, and every stream must end after a
+  // whole matrix
+  bool ok = st.errors == 0 && !st.truncated && (!st.check || st.count > 0);
+  if (st.check) {
+    if (st.errors > 0) {
+      fprintf(report, "Error: %ld of %ld matrices are not transposed correctly\n", st.errors, st.count);
+    } else if (st.truncated) {
+      fprintf(report, "Error: the stream is truncated after %ld matrices\n", st.count);
+    } else if (st.count == 0) {
+      fprintf(report, "Error: the stream holds no matrix\n");
+    } else {
+      fprintf(report, "Matrix transpose is correct\n");
+    }
+  }
+  qsort(st.latencies, st.count, sizeof(double), compare_doubles);
+  double p50 = 0, p90 = 0, p99 = 0, max = 0;
+  if (st.count > 0) {
+    p50 = percentile(st.latencies, st.count, 0.50);
+    p90 = percentile(st.latencies, st.count, 0.90);
+    p99 = percentile(st.latencies, st.count, 0.99);
+    max = st.latencies[st.count - 1];
+  }
+  if (verbose) {
+    fprintf(report, "Matrices: %ld of %d x %d, slots: %d, tile: %d\n", st.count, st.rows, st.cols, st.num_slots, transpose_plan_tile(st.plan));
+    fprintf(report, "Time taken for the stream: %.9fs, %.2f matrices/s, %.2f MB/s\n", elapsed,
+            st.count / elapsed, 2.0 * st.count * st.bytes / elapsed / (1 << 20));
+    fprintf(report, "Busy time - read: %.6fs, transpose: %.6fs, write: %.6fs\n", st.read_busy, st.compute_busy, st.write_busy);
+    fprintf(report, "Latency - p50: %.6fs, p90: %.6fs, p99: %.6fs, max: %.6fs\n", p50, p90, p99, max);
+  } else {
+    fprintf(report, "threads: %d, matrices: %ld, stream_time: %f, matrices_per_s: %f, latency_p50: %f, latency_p99: %f\n",
+            omp_get_max_threads(), st.count, elapsed, st.count / elapsed, p50, p99);
+  }
+
+  transpose_plan_destroy(st.plan);
+  free(st.latencies);
+  close(st.fd_in);
+  close(st.fd_out);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <omp.h>
+#include "utils.h"
+#include "transpose.h"
+
+// Value of element (i, j) of a float or double matrix with row stride ld
+double get_real(DType dt, const char *mat, size_t ld, int i, int j) {
+    size_t off = (size_t) i * ld + j;
+    return dt == DTYPE_FLOAT ? ((const float *) mat)[off] : ((const double *) mat)[off];
+}
+
+// Check B = alpha * A^T + beta * B0 inside the window of B and B = B0 around it
+bool check_omatcopy(DType dt, int rows, int cols, int pad, double alpha, double beta,
+                    const char *a, size_t lda, const char *b0, const char *b, size_t ldb) {
+    double eps = dt == DTYPE_FLOAT ? 1e-6 : 1e-14;
+    for (int i = 0; i < cols + 2 * pad; i++) {
+        for (int j = 0; j < rows + 2 * pad; j++) {
+            bool inside = i >= pad && i < cols + pad && j >= pad && j < rows + pad;
+            double old = get_real(dt, b0, ldb, i, j);
+            double expected = old;
+            double scale = fabs(old);
+            if (inside) {
+                double x = get_real(dt, a, lda, j, i);
+                expected = alpha * x + beta * old;
+                scale = fabs(alpha * x) + fabs(beta * old);
+            }
+            double got = get_real(dt, b, ldb, i, j);
+            if (fabs(got - expected) > 4 * eps * scale) {
+                printf("Error: B[%d][%d] = %g, expected %g\n", i, j, got, expected);
+                return false;
+            }
+        }
+    }
+    printf("Matrix transpose is correct\n");
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bool check, verbose, conj;
+    DType dt;
+
+    parse_dtype_args(&argc, argv, &dt, &conj);
+    const char *alpha_arg = take_option(&argc, argv, "--alpha", true);
+    const char *beta_arg = take_option(&argc, argv, "--beta", true);
+    const char *pad_arg = take_option(&argc, argv, "--pad", true);
+    if (argc < 3 || argc >= 6) {
+        printf("Usage: %s <rows> <cols> [<check_correctness>] [<verbose>] [--dtype float|double] [--alpha <a>] [--beta <b>] [--pad <p>]\n", argv[0]);
+        return 1;
+    }
+    int rows = atoi(argv[1]);
+    int cols = atoi(argv[2]);
+    check = argc >= 4 && strcmp(argv[3], "check") == 0;
+    verbose = argc >= 5 && strcmp(argv[4], "verbose") == 0;
+    double alpha = alpha_arg != NULL ? atof(alpha_arg) : 1;
+    double beta = beta_arg != NULL ? atof(beta_arg) : 0;
+    int pad = pad_arg != NULL ? atoi(pad_arg) : 16;
+    if (rows <= 0 || cols <= 0 || pad < 0) {
+        printf("Error: rows and cols must be positive integers and pad non-negative\n");
+        return 1;
+    }
+    if (dt != DTYPE_FLOAT && dt != DTYPE_DOUBLE) {
+        printf("Error: only float and double are supported\n");
+        return 1;
+    }
+    srand(time(NULL));
+
+    // The rows x cols window of A and the cols x rows window of B lie `pad` rows and columns
+    // inside larger buffers
+    size_t esz = dtype_size(dt);
+    size_t lda = cols + 2 * pad, ldb = rows + 2 * pad;
+    char **a, **b, **b0;
+    init_matrix(rows + 2 * pad, lda, esz, &a);
+    init_matrix(cols + 2 * pad, ldb, esz, &b);
+    init_matrix(cols + 2 * pad, ldb, esz, &b0);
+    for (size_t e = 0; e < (rows + 2 * pad) * lda; e++) {
+        dtype_set_rand(dt, a[0] + e * esz);
+    }
+    for (size_t e = 0; e < (cols + 2 * pad) * ldb; e++) {
+        dtype_set_rand(dt, b0[0] + e * esz);
+    }
+    memcpy(b[0], b0[0], (cols + 2 * pad) * ldb * esz);
+
+    TransposePlan *plan = transpose_plan_omatcopy(rows, cols, alpha, lda, beta, ldb, dt, 0, 0);
+    if (plan == NULL) {
+        printf("Error: cannot plan the transpose\n");
+        return 1;
+    }
+    double start, end;
+    start = omp_get_wtime();
+    transpose_execute(plan, ELEM(a, pad, pad, esz), ELEM(b, pad, pad, esz));
+    end = omp_get_wtime();
+
+    if (verbose) {
+        printf("Time taken for B = %g * A^T + %g * B on a %d x %d window (lda %zu, ldb %zu, tile %d): %.9fs\n",
+               alpha, beta, rows, cols, lda, ldb, transpose_plan_tile(plan), end - start);
+    } else {
+        printf("threads: %d, transpose_time: %f\n", omp_get_max_threads(), end - start);
+    }
+    if (check) {
+        check_omatcopy(dt, rows, cols, pad, alpha, beta, a[0], lda, b0[0], b[0], ldb);
+    }
+    transpose_plan_destroy(plan);
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <omp.h>
+#include "utils.h"
+#include "kernels.h"
+#include "transpose.h"
+
+int main(int argc, char **argv) {
+    bool check, verbose, conj;
+    int N;
+    DType dt;
+
+    parse_dtype_args(&argc, argv, &dt, &conj);
+    // Fraction of the column panels of the transpose that are read, and their width
+    const char *fraction_arg = take_option(&argc, argv, "--fraction", true);
+    const char *panel_arg = take_option(&argc, argv, "--panel", true);
+    // Tiles held by the cache of the view, 0 for the default
+    const char *cache_arg = take_option(&argc, argv, "--cache", true);
+    // Transpose the tiles of each panel in parallel before reading it
+    bool prefetch = take_option(&argc, argv, "--prefetch", false) != NULL;
+    parse_args(argc, argv, &N, &check, &verbose);
+    double fraction = fraction_arg != NULL ? atof(fraction_arg) : 0.1;
+    int panel = panel_arg != NULL ? atoi(panel_arg) : default_tile_size(dt);
+    int cache_tiles = cache_arg != NULL ? atoi(cache_arg) : 0;
+    if (fraction < 0 || fraction > 1 || panel <= 0 || cache_tiles < 0) {
+        printf("Error: the fraction must be between 0 and 1, the panel width positive\n");
+        return 1;
+    }
+    srand(time(NULL));
+
+    char **m;
+    init_matrix(N, N, dtype_size(dt), &m);
+    fill_rand_matrix(N, dt, &m);
+    size_t esz = dtype_size(dt);
+
+    // Random subset of the column panels of the transpose
+    int panels = (N + panel - 1) / panel;
+    int *order = (int *) malloc(panels * sizeof(int));
+    for (int p = 0; p < panels; p++) {
+        order[p] = p;
+    }
+    for (int p = panels - 1; p > 0; p--) {
+        int q = rand() % (p + 1);
+        int tmp = order[p];
+        order[p] = order[q];
+        order[q] = tmp;
+    }
+    int selected = (int) (fraction * panels + 0.5);
+
+    // Each panel is read into the same N x panel buffer, by bands of rows shared among the
+    // threads, which read the tiles of the view concurrently
+    TransposeView *view = transpose_view_create(m[0], N, N, 0, dt, 0, cache_tiles, conj ? TRANSPOSE_CONJ : 0);
+    char *out = (char *) malloc((size_t) N * panel * esz);
+    int rows_per_read = default_tile_size(dt);
+    bool correct = true;
+    double view_time = 0;
+    for (int k = 0; k < selected; k++) {
+        int j0 = order[k] * panel;
+        int width = j0 + panel <= N ? panel : N - j0;
+        double start = omp_get_wtime();
+        if (prefetch) {
+            transpose_view_prefetch(view, 0, j0, N, width, 0);
+        }
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < N; i += rows_per_read) {
+            int rows = i + rows_per_read <= N ? rows_per_read : N - i;
+            transpose_view_read(view, i, j0, rows, width, out + (size_t) i * width * esz, width);
+        }
+        view_time += omp_get_wtime() - start;
+        // Element (i, j) of the transpose is element (j, i) of the matrix
+        for (int i = 0; check && correct && i < N; i++) {
+            for (int j = 0; j < width; j++) {
+                if (!dtype_equal(dt, ELEM(m, j0 + j, i, esz), out + ((size_t) i * width + j) * esz, conj)) {
+                    printf("Error: element (%d, %d) of the view is wrong\n", i, j0 + j);
+                    correct = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Full materialisation of the transpose, for comparison
+    char **t;
+    init_matrix(N, N, esz, &t);
+    TransposePlan *plan = transpose_plan_create(N, N, 0, 0, dt, 0, 0, conj ? TRANSPOSE_CONJ : 0);
+    double full_start = omp_get_wtime();
+    transpose_execute(plan, m[0], t[0]);
+    double full_end = omp_get_wtime();
+
+    TransposeViewStats stats;
+    transpose_view_stats(view, &stats);
+    if (verbose) {
+        printf("Read %d of %d panels of %d columns in %.9fs, full transpose in %.9fs\n", selected, panels, panel,
+               view_time, full_end - full_start);
+        printf("Tiles transposed: %zu of %zu (%zu prefetched), hits: %zu, evictions: %zu, bypasses: %zu, cache: %zu bytes\n",
+               stats.misses, stats.total_tiles, stats.prefetched, stats.hits, stats.evictions, stats.bypasses,
+               stats.cache_bytes);
+    } else {
+        printf("threads: %d, view_time: %f, full_time: %f, tiles_transposed: %zu, tiles_total: %zu\n",
+               omp_get_max_threads(), view_time, full_end - full_start, stats.misses, stats.total_tiles);
+    }
+    if (check && correct) {
+        printf("Matrix transpose is correct\n");
+    }
+    transpose_plan_destroy(plan);
+    transpose_view_destroy(view);
+    free(order);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,250 @@
+#ifndef DTYPE_H
+#define DTYPE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Element types supported by the transpose engine. The kernels only depend on the width of
+/// the element, the type is needed to generate, print and compare values.
+typedef enum {
+  DTYPE_FLOAT,
+  DTYPE_DOUBLE,
+  DTYPE_INT8,
+  DTYPE_UINT8,
+  DTYPE_INT16,
+  DTYPE_BF16,
+  DTYPE_HALF,
+  DTYPE_COMPLEX64,
+  DTYPE_COMPLEX128,
+  DTYPE_COUNT
+} DType;
+
+typedef struct {
+  const char *name;
+  size_t size;
+  bool complex;
+} DTypeInfo;
+
+static const DTypeInfo dtype_info[DTYPE_COUNT] = {
+  [DTYPE_FLOAT] = {"float", 4, false},
+  [DTYPE_DOUBLE] = {"double", 8, false},
+  [DTYPE_INT8] = {"int8", 1, false},
+  [DTYPE_UINT8] = {"uint8", 1, false},
+  [DTYPE_INT16] = {"int16", 2, false},
+  [DTYPE_BF16] = {"bf16", 2, false},
+  [DTYPE_HALF] = {"half", 2, false},
+  [DTYPE_COMPLEX64] = {"complex64", 8, true},
+  [DTYPE_COMPLEX128] = {"complex128", 16, true},
+};
+
+static inline size_t dtype_size(DType dt) {
+  return dtype_info[dt].size;
+}
+
+static inline const char *dtype_name(DType dt) {
+  return dtype_info[dt].name;
+}
+
+/// Parse a type name, exiting with the list of supported types if it is unknown.
+static inline DType parse_dtype(const char *name) {
+  for (int dt = 0; dt < DTYPE_COUNT; dt++) {
+    if (strcmp(name, dtype_info[dt].name) == 0) {
+      return (DType) dt;
+    }
+  }
+  printf("Error: unknown dtype %s, supported types:", name);
+  for (int dt = 0; dt < DTYPE_COUNT; dt++) {
+    printf(" %s", dtype_info[dt].name);
+  }
+  printf("\n");
+  exit(1);
+}
+
+/// Rounding of the conversions to narrower types.
+typedef enum {
+  ROUND_NEAREST_EVEN,
+  ROUND_TOWARD_ZERO,
+} RoundMode;
+
+/// Convert a float to bfloat16.
+static inline uint16_t float_to_bf16_round(float f, RoundMode mode) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  if ((u & 0x7fffffff) > 0x7f800000) {
+    // Keep NaNs quiet instead of rounding them to infinity
+    return (uint16_t) ((u >> 16) | 0x40);
+  }
+  if (mode == ROUND_NEAREST_EVEN) {
+    u += 0x7fff + ((u >> 16) & 1);
+  }
+  return (uint16_t) (u >> 16);
+}
+
+/// Convert a float to bfloat16, rounding to nearest even.
+static inline uint16_t float_to_bf16(float f) {
+  return float_to_bf16_round(f, ROUND_NEAREST_EVEN);
+}
+
+static inline float bf16_to_float(uint16_t h) {
+  uint32_t u = (uint32_t) h << 16;
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+/// Convert a float to IEEE half precision. Rounding toward zero saturates to the largest
+/// finite half instead of overflowing to infinity, as F16C does.
+static inline uint16_t float_to_half_round(float f, RoundMode mode) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  uint16_t sign = (u >> 16) & 0x8000;
+  uint32_t abs = u & 0x7fffffff;
+  bool nearest = mode == ROUND_NEAREST_EVEN;
+  if (abs >= 0x7f800000) {
+    // Infinity or NaN
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  }
+  if (abs >= (nearest ? 0x477ff000 : 0x47800000)) {
+    // Rounds to a value above the largest half
+    return sign | (nearest ? 0x7c00 : 0x7bff);
+  }
+  if (abs < 0x38800000) {
+    // Subnormal half: shift the mantissa with the implicit bit into place and round
+    if (abs < 0x33000000) return sign;
+    uint32_t mant = (abs & 0x7fffff) | 0x800000;
+    int shift = 126 - (abs >> 23);
+    uint32_t half = mant >> shift;
+    uint32_t rem = mant & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (nearest && (rem > halfway || (rem == halfway && (half & 1)))) half++;
+    return sign | (uint16_t) half;
+  }
+  uint32_t half = ((abs >> 13) - (112 << 10));
+  uint32_t rem = abs & 0x1fff;
+  if (nearest && (rem > 0x1000 || (rem == 0x1000 && (half & 1)))) half++;
+  return sign | (uint16_t) half;
+}
+
+/// Convert a float to IEEE half precision, rounding to nearest even.
+static inline uint16_t float_to_half(float f) {
+  return float_to_half_round(f, ROUND_NEAREST_EVEN);
+}
+
+/// Quantise a float to int8: divide it by `scale`, round and saturate to [-128, 127]. NaN
+/// becomes 0.
+static inline int8_t float_to_int8_round(float f, float scale, RoundMode mode) {
+  float v = f / scale;
+  if (!(v == v)) {
+    return 0;
+  }
+  v = v < -128.0f ? -128.0f : (v > 127.0f ? 127.0f : v);
+  if (mode == ROUND_NEAREST_EVEN) {
+    // Adding and subtracting 2^23 rounds to an integer in the default rounding mode
+    float r = (v < 0 ? -v : v) + 8388608.0f - 8388608.0f;
+    v = v < 0 ? -r : r;
+  }
+  return (int8_t) v;
+}
+
+static inline float half_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t u;
+  if (exp == 0x1f) {
+    u = sign | 0x7f800000 | (mant << 13);
+  } else if (exp != 0) {
+    u = sign | ((exp + 112) << 23) | (mant << 13);
+  } else if (mant == 0) {
+    u = sign;
+  } else {
+    // Normalise the subnormal half
+    exp = 113;
+    while (!(mant & 0x400)) {
+      mant <<= 1;
+      exp--;
+    }
+    u = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+  }
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+/// Store the value re + i*im in `elem`, converting it to the element type. The imaginary part
+/// is ignored for real types.
+static inline void dtype_set(DType dt, void *elem, double re, double im) {
+  switch (dt) {
+    case DTYPE_FLOAT: *(float *) elem = (float) re; break;
+    case DTYPE_DOUBLE: *(double *) elem = re; break;
+    case DTYPE_INT8: *(int8_t *) elem = (int8_t) (int64_t) re; break;
+    case DTYPE_UINT8: *(uint8_t *) elem = (uint8_t) (int64_t) re; break;
+    case DTYPE_INT16: *(int16_t *) elem = (int16_t) (int64_t) re; break;
+    case DTYPE_BF16: *(uint16_t *) elem = float_to_bf16((float) re); break;
+    case DTYPE_HALF: *(uint16_t *) elem = float_to_half((float) re); break;
+    case DTYPE_COMPLEX64: ((float *) elem)[0] = (float) re; ((float *) elem)[1] = (float) im; break;
+    case DTYPE_COMPLEX128: ((double *) elem)[0] = re; ((double *) elem)[1] = im; break;
+    default: break;
+  }
+}
+
+/// Load the value stored in `elem` as a real and imaginary part.
+static inline void dtype_get(DType dt, const void *elem, double *re, double *im) {
+  *im = 0;
+  switch (dt) {
+    case DTYPE_FLOAT: *re = *(const float *) elem; break;
+    case DTYPE_DOUBLE: *re = *(const double *) elem; break;
+    case DTYPE_INT8: *re = *(const int8_t *) elem; break;
+    case DTYPE_UINT8: *re = *(const uint8_t *) elem; break;
+    case DTYPE_INT16: *re = *(const int16_t *) elem; break;
+    case DTYPE_BF16: *re = bf16_to_float(*(const uint16_t *) elem); break;
+    case DTYPE_HALF: *re = half_to_float(*(const uint16_t *) elem); break;
+    case DTYPE_COMPLEX64: *re = ((const float *) elem)[0]; *im = ((const float *) elem)[1]; break;
+    case DTYPE_COMPLEX128: *re = ((const double *) elem)[0]; *im = ((const double *) elem)[1]; break;
+    default: *re = 0; break;
+  }
+}
+
+/// Store a random value in `elem`: uniform in [0, 1) for floating point types and over the
+/// whole range for integer types.
+static inline void dtype_set_rand(DType dt, void *elem) {
+  if (dt == DTYPE_INT8 || dt == DTYPE_UINT8 || dt == DTYPE_INT16) {
+    dtype_set(dt, elem, rand(), 0);
+  } else {
+    dtype_set(dt, elem, rand() / (double) RAND_MAX, rand() / (double) RAND_MAX);
+  }
+}
+
+/// Negate the imaginary part of a complex element in place.
+static inline void dtype_conj(DType dt, void *elem) {
+  if (dt == DTYPE_COMPLEX64) {
+    ((float *) elem)[1] = -((float *) elem)[1];
+  } else if (dt == DTYPE_COMPLEX128) {
+    ((double *) elem)[1] = -((double *) elem)[1];
+  }
+}
+
+/// Check whether `b` equals `a`, or the conjugate of `a` when `conj` is set.
+static inline bool dtype_equal(DType dt, const void *a, const void *b, bool conj) {
+  char expected[16];
+  memcpy(expected, a, dtype_size(dt));
+  if (conj) {
+    dtype_conj(dt, expected);
+  }
+  return memcmp(expected, b, dtype_size(dt)) == 0;
+}
+
+static inline void dtype_print(DType dt, const void *elem) {
+  double re, im;
+  dtype_get(dt, elem, &re, &im);
+  if (dtype_info[dt].complex) {
+    printf("%f%+fi ", re, im);
+  } else {
+    printf("%f ", re);
+  }
+}
+
+#endif
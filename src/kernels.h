@@ -0,0 +1,505 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dtype.h"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Transpose kernels for elements of 1, 2, 4, 8 and 16 bytes. The kernels only move bits, so
+// every element type of a given width shares the same kernel. Each width has a micro-kernel
+// transposing a small square with SIMD registers; leading dimensions are in elements.
+
+typedef struct {
+  uint64_t v[2];
+} Elem128;
+
+#if defined(__SSE2__)
+// 8x8 bytes: interleave rows pairwise at byte, word and dword granularity
+static inline void micro_1(const uint8_t *src, size_t lds, uint8_t *dst, size_t ldd) {
+  __m128i r0 = _mm_loadl_epi64((const __m128i *) (src + 0 * lds));
+  __m128i r1 = _mm_loadl_epi64((const __m128i *) (src + 1 * lds));
+  __m128i r2 = _mm_loadl_epi64((const __m128i *) (src + 2 * lds));
+  __m128i r3 = _mm_loadl_epi64((const __m128i *) (src + 3 * lds));
+  __m128i r4 = _mm_loadl_epi64((const __m128i *) (src + 4 * lds));
+  __m128i r5 = _mm_loadl_epi64((const __m128i *) (src + 5 * lds));
+  __m128i r6 = _mm_loadl_epi64((const __m128i *) (src + 6 * lds));
+  __m128i r7 = _mm_loadl_epi64((const __m128i *) (src + 7 * lds));
+  __m128i a0 = _mm_unpacklo_epi8(r0, r1);
+  __m128i a1 = _mm_unpacklo_epi8(r2, r3);
+  __m128i a2 = _mm_unpacklo_epi8(r4, r5);
+  __m128i a3 = _mm_unpacklo_epi8(r6, r7);
+  __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+  __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+  __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+  __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+  __m128i c0 = _mm_unpacklo_epi32(b0, b2);
+  __m128i c1 = _mm_unpackhi_epi32(b0, b2);
+  __m128i c2 = _mm_unpacklo_epi32(b1, b3);
+  __m128i c3 = _mm_unpackhi_epi32(b1, b3);
+  _mm_storel_epi64((__m128i *) (dst + 0 * ldd), c0);
+  _mm_storel_epi64((__m128i *) (dst + 1 * ldd), _mm_unpackhi_epi64(c0, c0));
+  _mm_storel_epi64((__m128i *) (dst + 2 * ldd), c1);
+  _mm_storel_epi64((__m128i *) (dst + 3 * ldd), _mm_unpackhi_epi64(c1, c1));
+  _mm_storel_epi64((__m128i *) (dst + 4 * ldd), c2);
+  _mm_storel_epi64((__m128i *) (dst + 5 * ldd), _mm_unpackhi_epi64(c2, c2));
+  _mm_storel_epi64((__m128i *) (dst + 6 * ldd), c3);
+  _mm_storel_epi64((__m128i *) (dst + 7 * ldd), _mm_unpackhi_epi64(c3, c3));
+}
+#define MICRO_1 8
+
+// 8x8 16-bit words: interleave at word, dword and qword granularity
+static inline void micro_2(const uint16_t *src, size_t lds, uint16_t *dst, size_t ldd) {
+  __m128i r0 = _mm_loadu_si128((const __m128i *) (src + 0 * lds));
+  __m128i r1 = _mm_loadu_si128((const __m128i *) (src + 1 * lds));
+  __m128i r2 = _mm_loadu_si128((const __m128i *) (src + 2 * lds));
+  __m128i r3 = _mm_loadu_si128((const __m128i *) (src + 3 * lds));
+  __m128i r4 = _mm_loadu_si128((const __m128i *) (src + 4 * lds));
+  __m128i r5 = _mm_loadu_si128((const __m128i *) (src + 5 * lds));
+  __m128i r6 = _mm_loadu_si128((const __m128i *) (src + 6 * lds));
+  __m128i r7 = _mm_loadu_si128((const __m128i *) (src + 7 * lds));
+  __m128i a0 = _mm_unpacklo_epi16(r0, r1);
+  __m128i a1 = _mm_unpackhi_epi16(r0, r1);
+  __m128i a2 = _mm_unpacklo_epi16(r2, r3);
+  __m128i a3 = _mm_unpackhi_epi16(r2, r3);
+  __m128i a4 = _mm_unpacklo_epi16(r4, r5);
+  __m128i a5 = _mm_unpackhi_epi16(r4, r5);
+  __m128i a6 = _mm_unpacklo_epi16(r6, r7);
+  __m128i a7 = _mm_unpackhi_epi16(r6, r7);
+  __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+  __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+  __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+  __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+  __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+  __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+  __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+  __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+  _mm_storeu_si128((__m128i *) (dst + 0 * ldd), _mm_unpacklo_epi64(b0, b4));
+  _mm_storeu_si128((__m128i *) (dst + 1 * ldd), _mm_unpackhi_epi64(b0, b4));
+  _mm_storeu_si128((__m128i *) (dst + 2 * ldd), _mm_unpacklo_epi64(b1, b5));
+  _mm_storeu_si128((__m128i *) (dst + 3 * ldd), _mm_unpackhi_epi64(b1, b5));
+  _mm_storeu_si128((__m128i *) (dst + 4 * ldd), _mm_unpacklo_epi64(b2, b6));
+  _mm_storeu_si128((__m128i *) (dst + 5 * ldd), _mm_unpackhi_epi64(b2, b6));
+  _mm_storeu_si128((__m128i *) (dst + 6 * ldd), _mm_unpacklo_epi64(b3, b7));
+  _mm_storeu_si128((__m128i *) (dst + 7 * ldd), _mm_unpackhi_epi64(b3, b7));
+}
+#define MICRO_2 8
+#endif
+
+#if defined(__AVX__)
+// 8x8 32-bit elements in 256-bit registers
+static inline void micro_4(const uint32_t *src, size_t lds, uint32_t *dst, size_t ldd) {
+  __m256 r0 = _mm256_loadu_ps((const float *) (src + 0 * lds));
+  __m256 r1 = _mm256_loadu_ps((const float *) (src + 1 * lds));
+  __m256 r2 = _mm256_loadu_ps((const float *) (src + 2 * lds));
+  __m256 r3 = _mm256_loadu_ps((const float *) (src + 3 * lds));
+  __m256 r4 = _mm256_loadu_ps((const float *) (src + 4 * lds));
+  __m256 r5 = _mm256_loadu_ps((const float *) (src + 5 * lds));
+  __m256 r6 = _mm256_loadu_ps((const float *) (src + 6 * lds));
+  __m256 r7 = _mm256_loadu_ps((const float *) (src + 7 * lds));
+  __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+  __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+  __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+  __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+  __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+  __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+  __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+  __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+  __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  _mm256_storeu_ps((float *) (dst + 0 * ldd), _mm256_permute2f128_ps(s0, s4, 0x20));
+  _mm256_storeu_ps((float *) (dst + 1 * ldd), _mm256_permute2f128_ps(s1, s5, 0x20));
+  _mm256_storeu_ps((float *) (dst + 2 * ldd), _mm256_permute2f128_ps(s2, s6, 0x20));
+  _mm256_storeu_ps((float *) (dst + 3 * ldd), _mm256_permute2f128_ps(s3, s7, 0x20));
+  _mm256_storeu_ps((float *) (dst + 4 * ldd), _mm256_permute2f128_ps(s0, s4, 0x31));
+  _mm256_storeu_ps((float *) (dst + 5 * ldd), _mm256_permute2f128_ps(s1, s5, 0x31));
+  _mm256_storeu_ps((float *) (dst + 6 * ldd), _mm256_permute2f128_ps(s2, s6, 0x31));
+  _mm256_storeu_ps((float *) (dst + 7 * ldd), _mm256_permute2f128_ps(s3, s7, 0x31));
+}
+#define MICRO_4 8
+
+// 4x4 64-bit elements (double, complex64): 64-bit unpacks followed by a lane exchange
+static inline void micro_8(const uint64_t *src, size_t lds, uint64_t *dst, size_t ldd) {
+  __m256d r0 = _mm256_loadu_pd((const double *) (src + 0 * lds));
+  __m256d r1 = _mm256_loadu_pd((const double *) (src + 1 * lds));
+  __m256d r2 = _mm256_loadu_pd((const double *) (src + 2 * lds));
+  __m256d r3 = _mm256_loadu_pd((const double *) (src + 3 * lds));
+  __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+  __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+  __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+  __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+  _mm256_storeu_pd((double *) (dst + 0 * ldd), _mm256_permute2f128_pd(t0, t2, 0x20));
+  _mm256_storeu_pd((double *) (dst + 1 * ldd), _mm256_permute2f128_pd(t1, t3, 0x20));
+  _mm256_storeu_pd((double *) (dst + 2 * ldd), _mm256_permute2f128_pd(t0, t2, 0x31));
+  _mm256_storeu_pd((double *) (dst + 3 * ldd), _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+#define MICRO_8 4
+
+// 2x2 128-bit elements (complex128): exchange the 128-bit lanes of two rows
+static inline void micro_16(const Elem128 *src, size_t lds, Elem128 *dst, size_t ldd) {
+  __m256d r0 = _mm256_loadu_pd((const double *) (src + 0 * lds));
+  __m256d r1 = _mm256_loadu_pd((const double *) (src + 1 * lds));
+  _mm256_storeu_pd((double *) (dst + 0 * ldd), _mm256_permute2f128_pd(r0, r1, 0x20));
+  _mm256_storeu_pd((double *) (dst + 1 * ldd), _mm256_permute2f128_pd(r0, r1, 0x31));
+}
+#define MICRO_16 2
+#elif defined(__SSE2__)
+// 4x4 32-bit elements in 128-bit registers
+static inline void micro_4(const uint32_t *src, size_t lds, uint32_t *dst, size_t ldd) {
+  __m128 r0 = _mm_loadu_ps((const float *) (src + 0 * lds));
+  __m128 r1 = _mm_loadu_ps((const float *) (src + 1 * lds));
+  __m128 r2 = _mm_loadu_ps((const float *) (src + 2 * lds));
+  __m128 r3 = _mm_loadu_ps((const float *) (src + 3 * lds));
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+  _mm_storeu_ps((float *) (dst + 0 * ldd), r0);
+  _mm_storeu_ps((float *) (dst + 1 * ldd), r1);
+  _mm_storeu_ps((float *) (dst + 2 * ldd), r2);
+  _mm_storeu_ps((float *) (dst + 3 * ldd), r3);
+}
+#define MICRO_4 4
+
+// 2x2 64-bit elements
+static inline void micro_8(const uint64_t *src, size_t lds, uint64_t *dst, size_t ldd) {
+  __m128d r0 = _mm_loadu_pd((const double *) (src + 0 * lds));
+  __m128d r1 = _mm_loadu_pd((const double *) (src + 1 * lds));
+  _mm_storeu_pd((double *) (dst + 0 * ldd), _mm_unpacklo_pd(r0, r1));
+  _mm_storeu_pd((double *) (dst + 1 * ldd), _mm_unpackhi_pd(r0, r1));
+}
+#define MICRO_8 2
+#endif
+
+// Without a SIMD micro-kernel for a width, fall back to element by element copies
+#define DEFINE_SCALAR_MICRO(W, T)                                              \
+  static inline void micro_##W(const T *src, size_t lds, T *dst, size_t ldd) { \
+    dst[0] = src[0];                                                           \
+    (void) lds;                                                                \
+    (void) ldd;                                                                \
+  }
+#ifndef MICRO_1
+DEFINE_SCALAR_MICRO(1, uint8_t)
+#define MICRO_1 1
+#endif
+#ifndef MICRO_2
+DEFINE_SCALAR_MICRO(2, uint16_t)
+#define MICRO_2 1
+#endif
+#ifndef MICRO_4
+DEFINE_SCALAR_MICRO(4, uint32_t)
+#define MICRO_4 1
+#endif
+#ifndef MICRO_8
+DEFINE_SCALAR_MICRO(8, uint64_t)
+#define MICRO_8 1
+#endif
+#ifndef MICRO_16
+DEFINE_SCALAR_MICRO(16, Elem128)
+#define MICRO_16 1
+#endif
+
+// Transpose a rows x cols block with the micro-kernel of width W, handling the rows and
+// columns that do not fill a whole micro-kernel one element at a time
+#define DEFINE_TRANSPOSE_BLOCK(W, T)                                                              \
+  static inline void transpose_block_##W(const T *src, size_t lds, T *dst, size_t ldd, int rows, int cols) { \
+    int i = 0;                                                                                    \
+    for (; i + MICRO_##W <= rows; i += MICRO_##W) {                                               \
+      int j = 0;                                                                                  \
+      for (; j + MICRO_##W <= cols; j += MICRO_##W) {                                             \
+        micro_##W(src + (size_t) i * lds + j, lds, dst + (size_t) j * ldd + i, ldd);              \
+      }                                                                                           \
+      for (; j < cols; j++) {                                                                     \
+        for (int ii = i; ii < i + MICRO_##W; ii++) {                                              \
+          dst[(size_t) j * ldd + ii] = src[(size_t) ii * lds + j];                                \
+        }                                                                                         \
+      }                                                                                           \
+    }                                                                                             \
+    for (; i < rows; i++) {                                                                       \
+      for (int j = 0; j < cols; j++) {                                                            \
+        dst[(size_t) j * ldd + i] = src[(size_t) i * lds + j];                                    \
+      }                                                                                           \
+    }                                                                                             \
+  }
+DEFINE_TRANSPOSE_BLOCK(1, uint8_t)
+DEFINE_TRANSPOSE_BLOCK(2, uint16_t)
+DEFINE_TRANSPOSE_BLOCK(4, uint32_t)
+DEFINE_TRANSPOSE_BLOCK(8, uint64_t)
+DEFINE_TRANSPOSE_BLOCK(16, Elem128)
+
+/// Negate the imaginary parts of a rows x cols block of complex elements by flipping the sign
+/// bit of the upper half of every element.
+static inline void conj_block(DType dt, void *mat, size_t ld, int rows, int cols) {
+  if (dt == DTYPE_COMPLEX64) {
+    for (int i = 0; i < rows; i++) {
+      uint64_t *row = (uint64_t *) mat + (size_t) i * ld;
+      for (int j = 0; j < cols; j++) {
+        row[j] ^= 0x8000000000000000ull;
+      }
+    }
+  } else if (dt == DTYPE_COMPLEX128) {
+    for (int i = 0; i < rows; i++) {
+      Elem128 *row = (Elem128 *) mat + (size_t) i * ld;
+      for (int j = 0; j < cols; j++) {
+        row[j].v[1] ^= 0x8000000000000000ull;
+      }
+    }
+  }
+}
+
+/// Transpose the rows x cols block `src` into the cols x rows block `dst` with the kernel for
+/// the width of `dt`. Complex elements are conjugated while the block is still in cache when
+/// `conj` is set.
+static inline void transpose_block(DType dt, bool conj, const void *src, size_t lds, void *dst, size_t ldd, int rows, int cols) {
+  switch (dtype_size(dt)) {
+    case 1: transpose_block_1((const uint8_t *) src, lds, (uint8_t *) dst, ldd, rows, cols); break;
+    case 2: transpose_block_2((const uint16_t *) src, lds, (uint16_t *) dst, ldd, rows, cols); break;
+    case 4: transpose_block_4((const uint32_t *) src, lds, (uint32_t *) dst, ldd, rows, cols); break;
+    case 8: transpose_block_8((const uint64_t *) src, lds, (uint64_t *) dst, ldd, rows, cols); break;
+    case 16: transpose_block_16((const Elem128 *) src, lds, (Elem128 *) dst, ldd, rows, cols); break;
+  }
+  if (conj) {
+    conj_block(dt, dst, ldd, cols, rows);
+  }
+}
+
+/// Default tile side for a type: tile rows span a few cache lines and a source and destination
+/// tile fit in L1 together, so narrow types use larger tiles.
+static inline int default_tile_size(DType dt) {
+  switch (dtype_size(dt)) {
+    case 1: return 128;
+    case 2: return 64;
+    case 4: return 64;
+    case 8: return 32;
+    default: return 16;
+  }
+}
+
+/// Transpose the rows x cols matrix `src` into `dst` one tile x tile block at a time.
+static inline void transpose_tiled(DType dt, bool conj, const void *src, size_t lds, void *dst, size_t ldd, int rows, int cols, int tile) {
+  size_t esz = dtype_size(dt);
+  for (int i = 0; i < rows; i += tile) {
+    for (int j = 0; j < cols; j += tile) {
+      int h = (i + tile < rows) ? tile : rows - i;
+      int w = (j + tile < cols) ? tile : cols - j;
+      transpose_block(dt, conj, (const char *) src + ((size_t) i * lds + j) * esz, lds,
+                      (char *) dst + ((size_t) j * ldd + i) * esz, ldd, h, w);
+    }
+  }
+}
+
+// Scaled transpose of real elements, dst = alpha * src^T + beta * dst. Each micro-block is
+// transposed by the bit-moving micro-kernel of the width into a small buffer and combined with
+// dst row by row; the fixed-length combine loops are vectorised by the compiler. dst is not
+// read when beta is 0, as in BLAS.
+#define DEFINE_SCALED_TRANSPOSE_BLOCK(NAME, W, T, U)                                                  \
+  static inline void NAME##_row(const T *t, T *d, int n, T alpha, T beta) {                            \
+    if (beta == 0) {                                                                                    \
+      for (int c = 0; c < n; c++) d[c] = alpha * t[c];                                                  \
+    } else {                                                                                            \
+      for (int c = 0; c < n; c++) d[c] = alpha * t[c] + beta * d[c];                                    \
+    }                                                                                                   \
+  }                                                                                                     \
+  static inline void NAME(const T *src, size_t lds, T *dst, size_t ldd, int rows, int cols, T alpha, T beta) { \
+    T tmp[MICRO_##W * MICRO_##W];                                                                       \
+    int i = 0;                                                                                          \
+    for (; i + MICRO_##W <= rows; i += MICRO_##W) {                                                     \
+      int j = 0;                                                                                        \
+      for (; j + MICRO_##W <= cols; j += MICRO_##W) {                                                   \
+        micro_##W((const U *) (src + (size_t) i * lds + j), lds, (U *) tmp, MICRO_##W);                 \
+        for (int r = 0; r < MICRO_##W; r++) {                                                           \
+          NAME##_row(tmp + r * MICRO_##W, dst + (size_t) (j + r) * ldd + i, MICRO_##W, alpha, beta);    \
+        }                                                                                               \
+      }                                                                                                 \
+      for (; j < cols; j++) {                                                                           \
+        for (int ii = 0; ii < MICRO_##W; ii++) {                                                        \
+          tmp[ii] = src[(size_t) (i + ii) * lds + j];                                                   \
+        }                                                                                               \
+        NAME##_row(tmp, dst + (size_t) j * ldd + i, MICRO_##W, alpha, beta);                            \
+      }                                                                                                 \
+    }                                                                                                   \
+    for (; i < rows; i++) {                                                                             \
+      for (int j = 0; j < cols; j++) {                                                                  \
+        NAME##_row(src + (size_t) i * lds + j, dst + (size_t) j * ldd + i, 1, alpha, beta);             \
+      }                                                                                                 \
+    }                                                                                                   \
+  }
+DEFINE_SCALED_TRANSPOSE_BLOCK(transpose_block_scaled_f32, 4, float, uint32_t)
+DEFINE_SCALED_TRANSPOSE_BLOCK(transpose_block_scaled_f64, 8, double, uint64_t)
+
+/// Scaled transpose dst = alpha * src^T + beta * dst of a rows x cols block of float or double
+/// elements. Other types are left untouched.
+static inline void transpose_block_scaled(DType dt, const void *src, size_t lds, void *dst, size_t ldd, int rows, int cols, double alpha, double beta) {
+  if (dt == DTYPE_FLOAT) {
+    transpose_block_scaled_f32((const float *) src, lds, (float *) dst, ldd, rows, cols, (float) alpha, (float) beta);
+  } else if (dt == DTYPE_DOUBLE) {
+    transpose_block_scaled_f64((const double *) src, lds, (double *) dst, ldd, rows, cols, alpha, beta);
+  }
+}
+
+// Conversion of a row of n floats to a narrower type. Rows of 8 are converted with AVX2 and
+// F16C when available, other lengths one element at a time. `scale` is only used by int8.
+static inline void convert_row_bf16(const float *t, uint16_t *d, int n, float scale, RoundMode mode) {
+  (void) scale;
+#if defined(__AVX2__)
+  if (n == 8) {
+    __m256i u = _mm256_castps_si256(_mm256_loadu_ps(t));
+    __m256i r = u;
+    if (mode == ROUND_NEAREST_EVEN) {
+      __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1));
+      r = _mm256_add_epi32(u, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff)));
+    }
+    r = _mm256_srli_epi32(r, 16);
+    // Keep NaNs quiet instead of rounding them to infinity
+    __m256i abs = _mm256_and_si256(u, _mm256_set1_epi32(0x7fffffff));
+    __m256i nan = _mm256_cmpgt_epi32(abs, _mm256_set1_epi32(0x7f800000));
+    __m256i quiet = _mm256_or_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(0x40));
+    r = _mm256_blendv_epi8(r, quiet, nan);
+    __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+    _mm_storeu_si128((__m128i *) d, packed);
+    return;
+  }
+#endif
+  for (int c = 0; c < n; c++) d[c] = float_to_bf16_round(t[c], mode);
+}
+
+static inline void convert_row_half(const float *t, uint16_t *d, int n, float scale, RoundMode mode) {
+  (void) scale;
+#if defined(__AVX__) && defined(__F16C__)
+  if (n == 8) {
+    __m256 v = _mm256_loadu_ps(t);
+    __m128i h = mode == ROUND_NEAREST_EVEN ? _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+                                           : _mm256_cvtps_ph(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    _mm_storeu_si128((__m128i *) d, h);
+    return;
+  }
+#endif
+  for (int c = 0; c < n; c++) d[c] = float_to_half_round(t[c], mode);
+}
+
+static inline void convert_row_int8(const float *t, int8_t *d, int n, float scale, RoundMode mode) {
+#if defined(__AVX2__)
+  if (n == 8) {
+    __m256 v = _mm256_div_ps(_mm256_loadu_ps(t), _mm256_set1_ps(scale));
+    // NaN becomes 0, then saturate so that the conversion cannot overflow
+    v = _mm256_and_ps(v, _mm256_cmp_ps(v, v, _CMP_ORD_Q));
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-128.0f)), _mm256_set1_ps(127.0f));
+    __m256i q = mode == ROUND_NEAREST_EVEN ? _mm256_cvtps_epi32(v) : _mm256_cvttps_epi32(v);
+    __m128i q16 = _mm_packs_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+    _mm_storel_epi64((__m128i *) d, _mm_packs_epi16(q16, q16));
+    return;
+  }
+#endif
+  for (int c = 0; c < n; c++) d[c] = float_to_int8_round(t[c], scale, mode);
+}
+
+// Conversion of a row of n bf16 or half elements back to floats, 8 at a time with AVX2 and F16C
+// when available.
+static inline void widen_row_bf16(const uint16_t *t, float *d, int n) {
+  int c = 0;
+#if defined(__AVX2__)
+  for (; c + 8 <= n; c += 8) {
+    __m256i u = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (t + c)));
+    _mm256_storeu_ps(d + c, _mm256_castsi256_ps(_mm256_slli_epi32(u, 16)));
+  }
+#endif
+  for (; c < n; c++) d[c] = bf16_to_float(t[c]);
+}
+
+static inline void widen_row_half(const uint16_t *t, float *d, int n) {
+  int c = 0;
+#if defined(__AVX__) && defined(__F16C__)
+  for (; c + 8 <= n; c += 8) {
+    _mm256_storeu_ps(d + c, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (t + c))));
+  }
+#endif
+  for (; c < n; c++) d[c] = half_to_float(t[c]);
+}
+
+// Transpose a rows x cols block of floats into a cols x rows block of type T, converting the
+// elements in the same pass. Each micro-block is transposed by the 4-byte micro-kernel into a
+// small buffer and converted row by row while in L1. Row j of dst uses scale scales[j * step].
+#define DEFINE_CONVERT_TRANSPOSE_BLOCK(NAME, T)                                                         \
+  static inline void transpose_block_to_##NAME(const float *src, size_t lds, T *dst, size_t ldd, int rows, int cols, \
+                                               const float *scales, int step, RoundMode mode) {            \
+    float tmp[MICRO_4 * MICRO_4];                                                                         \
+    int i = 0;                                                                                            \
+    for (; i + MICRO_4 <= rows; i += MICRO_4) {                                                           \
+      int j = 0;                                                                                          \
+      for (; j + MICRO_4 <= cols; j += MICRO_4) {                                                         \
+        micro_4((const uint32_t *) (src + (size_t) i * lds + j), lds, (uint32_t *) tmp, MICRO_4);         \
+        for (int r = 0; r < MICRO_4; r++) {                                                               \
+          convert_row_##NAME(tmp + r * MICRO_4, dst + (size_t) (j + r) * ldd + i, MICRO_4,                \
+                             scales[(j + r) * step], mode);                                               \
+        }                                                                                                 \
+      }                                                                                                   \
+      for (; j < cols; j++) {                                                                             \
+        for (int ii = 0; ii < MICRO_4; ii++) {                                                            \
+          tmp[ii] = src[(size_t) (i + ii) * lds + j];                                                     \
+        }                                                                                                 \
+        convert_row_##NAME(tmp, dst + (size_t) j * ldd + i, MICRO_4, scales[j * step], mode);             \
+      }                                                                                                   \
+    }                                                                                                     \
+    for (; i < rows; i++) {                                                                               \
+      for (int j = 0; j < cols; j++) {                                                                    \
+        convert_row_##NAME(src + (size_t) i * lds + j, dst + (size_t) j * ldd + i, 1, scales[j * step], mode); \
+      }                                                                                                   \
+    }                                                                                                     \
+  }
+DEFINE_CONVERT_TRANSPOSE_BLOCK(bf16, uint16_t)
+DEFINE_CONVERT_TRANSPOSE_BLOCK(half, uint16_t)
+DEFINE_CONVERT_TRANSPOSE_BLOCK(int8, int8_t)
+
+/// Transpose a rows x cols block of floats into a cols x rows block of bf16, half or int8
+/// elements. int8 elements are quantised with the scale of their row, scales[j * step] for
+/// row j of dst: step 1 gives one scale per row, step 0 one scale for the whole block.
+static inline void transpose_block_convert(DType to, RoundMode mode, const float *src, size_t lds, void *dst, size_t ldd,
+                                           int rows, int cols, const float *scales, int step) {
+  static const float unit_scale = 1.0f;
+  switch (to) {
+    case DTYPE_BF16: transpose_block_to_bf16(src, lds, (uint16_t *) dst, ldd, rows, cols, &unit_scale, 0, mode); break;
+    case DTYPE_HALF: transpose_block_to_half(src, lds, (uint16_t *) dst, ldd, rows, cols, &unit_scale, 0, mode); break;
+    case DTYPE_INT8: transpose_block_to_int8(src, lds, (int8_t *) dst, ldd, rows, cols, scales, step, mode); break;
+    default: break;
+  }
+}
+
+// Square transposes of a size known at compile time. flatten inlines the width kernels, so
+// every loop bound is a constant and the micro-kernel loops are fully unrolled.
+#define DEFINE_FIXED_TRANSPOSE(N)                                                                      \
+  __attribute__((flatten)) static void transpose_fixed_##N(DType dt, bool conj, const void *src, void *dst) { \
+    switch (dtype_size(dt)) {                                                                          \
+      case 1: transpose_block_1((const uint8_t *) src, N, (uint8_t *) dst, N, N, N); break;            \
+      case 2: transpose_block_2((const uint16_t *) src, N, (uint16_t *) dst, N, N, N); break;          \
+      case 4: transpose_block_4((const uint32_t *) src, N, (uint32_t *) dst, N, N, N); break;          \
+      case 8: transpose_block_8((const uint64_t *) src, N, (uint64_t *) dst, N, N, N); break;          \
+      case 16: transpose_block_16((const Elem128 *) src, N, (Elem128 *) dst, N, N, N); break;          \
+    }                                                                                                  \
+    if (conj) {                                                                                        \
+      conj_block(dt, dst, N, N, N);                                                                    \
+    }                                                                                                  \
+  }
+DEFINE_FIXED_TRANSPOSE(8)
+DEFINE_FIXED_TRANSPOSE(16)
+DEFINE_FIXED_TRANSPOSE(32)
+DEFINE_FIXED_TRANSPOSE(64)
+
+typedef void (*FixedTranspose)(DType dt, bool conj, const void *src, void *dst);
+
+/// Specialised kernel transposing a dense N x N matrix, or NULL if there is none for N.
+static inline FixedTranspose fixed_transpose_kernel(int N) {
+  switch (N) {
+    case 8: return transpose_fixed_8;
+    case 16: return transpose_fixed_16;
+    case 32: return transpose_fixed_32;
+    case 64: return transpose_fixed_64;
+    default: return NULL;
+  }
+}
+
+#endif
@@ -0,0 +1,205 @@
+#include <limits.h>
+#include <mpi.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dtype.h"
+#include "transpose_mpi.h"
+
+// Largest element count passed to a single non large-count MPI call
+#define LARGE_COUNT_CHUNK (1 << 30)
+
+/// Broadcast `count` elements of type `type`. The count may exceed INT_MAX: with MPI-4 the
+/// large-count routine is used, otherwise the buffer is broadcast in chunks of at most
+/// LARGE_COUNT_CHUNK elements.
+static inline void bcast_large(void *buf, size_t count, MPI_Datatype type, int root, MPI_Comm comm) {
+#if MPI_VERSION >= 4
+  MPI_Bcast_c(buf, (MPI_Count) count, type, root, comm);
+#else
+  MPI_Aint lb, extent;
+  MPI_Type_get_extent(type, &lb, &extent);
+  char *ptr = (char *) buf;
+  while (count > 0) {
+    int chunk = count > LARGE_COUNT_CHUNK ? LARGE_COUNT_CHUNK : (int) count;
+    MPI_Bcast(ptr, chunk, type, root, comm);
+    ptr += (size_t) chunk * extent;
+    count -= chunk;
+  }
+#endif
+}
+
+#if MPI_VERSION < 4
+// Copy the n 64-bit counts or displacements `v` into `out`. Returns false if one does not fit
+// in an int.
+static inline bool narrow_counts(const int64_t *v, int n, int *out) {
+  bool fits = true;
+  for (int p = 0; p < n; p++) {
+    fits = fits && v[p] >= 0 && v[p] <= INT_MAX;
+    out[p] = fits ? (int) v[p] : 0;
+  }
+  return fits;
+}
+
+// Agree on whether the counts of every rank fit in an int, rank 0 reporting when they do not
+static inline bool agree_counts_fit(bool fits, MPI_Comm comm) {
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Allreduce(MPI_IN_PLACE, &fits, 1, MPI_C_BOOL, MPI_LAND, comm);
+  if (!fits && rank == 0) {
+    printf("Error: messages of more than INT_MAX elements need an MPI-4 library\n");
+  }
+  return fits;
+}
+#endif
+
+/// MPI_Alltoallv with 64-bit counts and displacements, in elements of `type`. With MPI-4 the
+/// large-count routine is used; otherwise every count and displacement must fit in an int, and
+/// when one does not nothing is exchanged and false is returned on every rank. Collective.
+static inline bool alltoallv_large(const void *send, const int64_t *send_counts, const int64_t *send_displs,
+                                   void *recv, const int64_t *recv_counts, const int64_t *recv_displs,
+                                   MPI_Datatype type, MPI_Comm comm) {
+  int size;
+  MPI_Comm_size(comm, &size);
+#if MPI_VERSION >= 4
+  MPI_Count *counts = (MPI_Count *) malloc(2 * size * sizeof(MPI_Count));
+  MPI_Aint *displs = (MPI_Aint *) malloc(2 * size * sizeof(MPI_Aint));
+  for (int p = 0; p < size; p++) {
+    counts[p] = send_counts[p];
+    counts[size + p] = recv_counts[p];
+    displs[p] = send_displs[p];
+    displs[size + p] = recv_displs[p];
+  }
+  MPI_Alltoallv_c(send, counts, displs, type, recv, counts + size, displs + size, type, comm);
+  free(counts);
+  free(displs);
+  return true;
+#else
+  int *counts = (int *) malloc(4 * size * sizeof(int));
+  bool fits = narrow_counts(send_counts, size, counts) && narrow_counts(send_displs, size, counts + size) &&
+              narrow_counts(recv_counts, size, counts + 2 * size) && narrow_counts(recv_displs, size, counts + 3 * size);
+  fits = agree_counts_fit(fits, comm);
+  if (fits) {
+    MPI_Alltoallv(send, counts, counts + size, type, recv, counts + 2 * size, counts + 3 * size, type, comm);
+  }
+  free(counts);
+  return fits;
+#endif
+}
+
+/// MPI_Scatterv with 64-bit counts and displacements, which are only read on the root. Same
+/// large-count handling as alltoallv_large. Collective.
+static inline bool scatterv_large(const void *send, const int64_t *send_counts, const int64_t *send_displs,
+                                  void *recv, int64_t recv_count, MPI_Datatype type, int root, MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+#if MPI_VERSION >= 4
+  MPI_Count *counts = NULL;
+  MPI_Aint *displs = NULL;
+  if (rank == root) {
+    counts = (MPI_Count *) malloc(size * sizeof(MPI_Count));
+    displs = (MPI_Aint *) malloc(size * sizeof(MPI_Aint));
+    for (int p = 0; p < size; p++) {
+      counts[p] = send_counts[p];
+      displs[p] = send_displs[p];
+    }
+  }
+  MPI_Scatterv_c(send, counts, displs, type, recv, (MPI_Count) recv_count, type, root, comm);
+  free(counts);
+  free(displs);
+  return true;
+#else
+  int *counts = (int *) malloc((2 * size + 1) * sizeof(int));
+  bool fits = narrow_counts(&recv_count, 1, counts + 2 * size);
+  if (rank == root) {
+    fits = fits && narrow_counts(send_counts, size, counts) && narrow_counts(send_displs, size, counts + size);
+  }
+  fits = agree_counts_fit(fits, comm);
+  if (fits) {
+    MPI_Scatterv(send, counts, counts + size, type, recv, counts[2 * size], type, root, comm);
+  }
+  free(counts);
+  return fits;
+#endif
+}
+
+/// MPI_Gatherv with 64-bit counts and displacements, which are only read on the root. Same
+/// large-count handling as alltoallv_large. Collective.
+static inline bool gatherv_large(const void *send, int64_t send_count, void *recv, const int64_t *recv_counts,
+                                 const int64_t *recv_displs, MPI_Datatype type, int root, MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+#if MPI_VERSION >= 4
+  MPI_Count *counts = NULL;
+  MPI_Aint *displs = NULL;
+  if (rank == root) {
+    counts = (MPI_Count *) malloc(size * sizeof(MPI_Count));
+    displs = (MPI_Aint *) malloc(size * sizeof(MPI_Aint));
+    for (int p = 0; p < size; p++) {
+      counts[p] = recv_counts[p];
+      displs[p] = recv_displs[p];
+    }
+  }
+  MPI_Gatherv_c(send, (MPI_Count) send_count, type, recv, counts, displs, type, root, comm);
+  free(counts);
+  free(displs);
+  return true;
+#else
+  int *counts = (int *) malloc((2 * size + 1) * sizeof(int));
+  bool fits = narrow_counts(&send_count, 1, counts + 2 * size);
+  if (rank == root) {
+    fits = fits && narrow_counts(recv_counts, size, counts) && narrow_counts(recv_displs, size, counts + size);
+  }
+  fits = agree_counts_fit(fits, comm);
+  if (fits) {
+    MPI_Gatherv(send, counts[2 * size], type, recv, counts, counts + size, type, root, comm);
+  }
+  free(counts);
+  return fits;
+#endif
+}
+
+/// Create a datatype describing a contiguous row of `len` elements. Exchanging whole rows
+/// instead of single elements keeps the counts passed to MPI below INT_MAX for matrices with
+/// more than 2^31 elements.
+static inline MPI_Datatype create_row_type(int len, MPI_Datatype elem_type) {
+  MPI_Datatype row_type;
+  MPI_Type_contiguous(len, elem_type, &row_type);
+  MPI_Type_commit(&row_type);
+  return row_type;
+}
+
+/// MPI datatype matching an element type. bf16 and half have no MPI equivalent and are sent
+/// as 16-bit integers, which preserves their bit patterns.
+static inline MPI_Datatype dtype_mpi_type(DType dt) {
+  switch (dt) {
+    case DTYPE_FLOAT: return MPI_FLOAT;
+    case DTYPE_DOUBLE: return MPI_DOUBLE;
+    case DTYPE_INT8: return MPI_INT8_T;
+    case DTYPE_UINT8: return MPI_UINT8_T;
+    case DTYPE_INT16: return MPI_INT16_T;
+    case DTYPE_BF16: return MPI_UINT16_T;
+    case DTYPE_HALF: return MPI_UINT16_T;
+    case DTYPE_COMPLEX64: return MPI_C_FLOAT_COMPLEX;
+    case DTYPE_COMPLEX128: return MPI_C_DOUBLE_COMPLEX;
+    default: return MPI_DATATYPE_NULL;
+  }
+}
+
+/// TRANSPOSE_WIRE_* flag selected by a `--wire` option: native (0), bf16, half or shuffle.
+static inline unsigned parse_wire(const char *name) {
+  if (name == NULL || strcmp(name, "native") == 0) {
+    return 0;
+  } else if (strcmp(name, "bf16") == 0) {
+    return TRANSPOSE_WIRE_BF16;
+  } else if (strcmp(name, "half") == 0) {
+    return TRANSPOSE_WIRE_HALF;
+  } else if (strcmp(name, "shuffle") == 0) {
+    return TRANSPOSE_WIRE_SHUFFLE;
+  }
+  printf("Error: unknown wire format %s, supported formats: native bf16 half shuffle\n", name);
+  exit(1);
+}
@@ -0,0 +1,61 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+// Marker pushed into a queue to signal the end of the stream
+#define END_OF_STREAM -1
+
+/// Bounded blocking queue of buffer slot indices. The stages of a pipeline pass ownership of
+/// pre-allocated buffers to each other by pushing the index of the slot into the queue of the
+/// next stage.
+typedef struct {
+  int *items;
+  int capacity;
+  int head;
+  int count;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} SlotQueue;
+
+void queue_init(SlotQueue *q, int capacity) {
+  q->items = (int *) malloc(capacity * sizeof(int));
+  q->capacity = capacity;
+  q->head = 0;
+  q->count = 0;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_empty, NULL);
+  pthread_cond_init(&q->not_full, NULL);
+}
+
+void queue_destroy(SlotQueue *q) {
+  free(q->items);
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->not_empty);
+  pthread_cond_destroy(&q->not_full);
+}
+
+/// Append a slot index, blocking while the queue is full.
+void queue_push(SlotQueue *q, int item) {
+  pthread_mutex_lock(&q->lock);
+  while (q->count == q->capacity) {
+    pthread_cond_wait(&q->not_full, &q->lock);
+  }
+  q->items[(q->head + q->count) % q->capacity] = item;
+  q->count++;
+  pthread_cond_signal(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+/// Remove the oldest slot index, blocking while the queue is empty.
+int queue_pop(SlotQueue *q) {
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0) {
+    pthread_cond_wait(&q->not_empty, &q->lock);
+  }
+  int item = q->items[q->head];
+  q->head = (q->head + 1) % q->capacity;
+  q->count--;
+  pthread_cond_signal(&q->not_full);
+  pthread_mutex_unlock(&q->lock);
+  return item;
+}
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "sparse.h"
+
+static int max_threads(void) {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+bool sparse_alloc(SparseMatrix *m, int rows, int cols, int64_t nnz, DType dt) {
+  m->rows = rows;
+  m->cols = cols;
+  m->nnz = nnz;
+  m->dt = dt;
+  m->row_ptr = (int64_t *) malloc(((size_t) rows + 1) * sizeof(int64_t));
+  // One extra element so that empty matrices still get valid pointers
+  m->col_idx = (int *) malloc(((size_t) nnz + 1) * sizeof(int));
+  m->values = malloc(((size_t) nnz + 1) * dtype_size(dt));
+  if (m->row_ptr == NULL || m->col_idx == NULL || m->values == NULL) {
+    sparse_free(m);
+    return false;
+  }
+  return true;
+}
+
+void sparse_free(SparseMatrix *m) {
+  free(m->row_ptr);
+  free(m->col_idx);
+  free(m->values);
+  m->row_ptr = NULL;
+  m->col_idx = NULL;
+  m->values = NULL;
+}
+
+// First row of band k of `bands` bands holding about the same number of elements
+static int band_start(const SparseMatrix *a, int k, int bands) {
+  int64_t target = a->nnz * k / bands;
+  int lo = 0, hi = a->rows;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (a->row_ptr[mid] < target) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return k == bands ? a->rows : lo;
+}
+
+bool sparse_transpose(const SparseMatrix *a, SparseMatrix *t, int threads, bool conj) {
+  if (!sparse_alloc(t, a->cols, a->rows, a->nnz, a->dt)) {
+    return false;
+  }
+  int cols = a->cols;
+  size_t esz = dtype_size(a->dt);
+  conj = conj && dtype_info[a->dt].complex;
+  // Each band of rows has its own counters; the bands are assigned to the threads by static
+  // loops of the same length, so a thread always handles the same bands
+  int bands = threads == 0 ? max_threads() : threads;
+  bands = bands < a->rows ? bands : (a->rows > 0 ? a->rows : 1);
+  int64_t *counts = (int64_t *) malloc((size_t) bands * cols * sizeof(int64_t));
+  int64_t *chunk_sum = (int64_t *) malloc(((size_t) bands + 1) * sizeof(int64_t));
+  int *first = (int *) malloc(((size_t) bands + 1) * sizeof(int));
+  if (counts == NULL || chunk_sum == NULL || first == NULL) {
+    free(counts);
+    free(chunk_sum);
+    free(first);
+    sparse_free(t);
+    return false;
+  }
+  for (int k = 0; k <= bands; k++) {
+    first[k] = band_start(a, k, bands);
+  }
+  int64_t *col_ptr = t->row_ptr;
+
+  #pragma omp parallel num_threads(bands) if (bands > 1)
+  {
+    // Histogram of the columns of each band
+    #pragma omp for schedule(static)
+    for (int k = 0; k < bands; k++) {
+      int64_t *count = counts + (size_t) k * cols;
+      memset(count, 0, (size_t) cols * sizeof(int64_t));
+      for (int64_t e = a->row_ptr[first[k]]; e < a->row_ptr[first[k + 1]]; e++) {
+        count[a->col_idx[e]]++;
+      }
+    }
+    // For each column, offset of every band within the column, and size of the column
+    #pragma omp for schedule(static)
+    for (int c = 0; c < cols; c++) {
+      int64_t sum = 0;
+      for (int k = 0; k < bands; k++) {
+        int64_t count = counts[(size_t) k * cols + c];
+        counts[(size_t) k * cols + c] = sum;
+        sum += count;
+      }
+      col_ptr[c + 1] = sum;
+    }
+    // Prefix sum of the column sizes: every chunk of columns is summed, the sums are scanned,
+    // then every chunk is scanned from its offset
+    #pragma omp for schedule(static)
+    for (int k = 0; k < bands; k++) {
+      int64_t sum = 0;
+      for (int c = (int) ((int64_t) cols * k / bands); c < (int) ((int64_t) cols * (k + 1) / bands); c++) {
+        sum += col_ptr[c + 1];
+      }
+      chunk_sum[k + 1] = sum;
+    }
+    #pragma omp single
+    {
+      chunk_sum[0] = 0;
+      col_ptr[0] = 0;
+      for (int k = 0; k < bands; k++) {
+        chunk_sum[k + 1] += chunk_sum[k];
+      }
+    }
+    #pragma omp for schedule(static)
+    for (int k = 0; k < bands; k++) {
+      int64_t offset = chunk_sum[k];
+      for (int c = (int) ((int64_t) cols * k / bands); c < (int) ((int64_t) cols * (k + 1) / bands); c++) {
+        offset += col_ptr[c + 1];
+        col_ptr[c + 1] = offset;
+      }
+    }
+    // Scatter the elements of each band. Bands and rows are visited in increasing order, so
+    // the rows of the transpose come out sorted
+    #pragma omp for schedule(static)
+    for (int k = 0; k < bands; k++) {
+      int64_t *offset = counts + (size_t) k * cols;
+      for (int i = first[k]; i < first[k + 1]; i++) {
+        for (int64_t e = a->row_ptr[i]; e < a->row_ptr[i + 1]; e++) {
+          int c = a->col_idx[e];
+          int64_t pos = col_ptr[c] + offset[c]++;
+          t->col_idx[pos] = i;
+          char *value = (char *) t->values + pos * esz;
+          memcpy(value, (const char *) a->values + e * esz, esz);
+          if (conj) {
+            dtype_conj(a->dt, value);
+          }
+        }
+      }
+    }
+  }
+  free(counts);
+  free(chunk_sum);
+  free(first);
+  return true;
+}
+
+static inline uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// Uniform double in [0, 1)
+static inline double unit_random(uint64_t *state) {
+  return (splitmix64(state) >> 11) * 0x1.0p-53;
+}
+
+static int compare_ints(const void *a, const void *b) {
+  int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+// Number of elements of row i, drawn first from the generator of the row
+static int row_length(uint64_t *state, int cols, double density) {
+  double expected = density * cols;
+  int length = (int) expected;
+  if (unit_random(state) < expected - length) {
+    length++;
+  }
+  return length < cols ? length : cols;
+}
+
+// Draw k distinct sorted columns out of cols
+static void draw_columns(uint64_t *state, int cols, int k, int *out) {
+  if (k > cols / 2) {
+    // Selection sampling: keep each column with probability needed / remaining
+    int n = 0;
+    for (int c = 0; c < cols && n < k; c++) {
+      if (unit_random(state) * (cols - c) < k - n) {
+        out[n++] = c;
+      }
+    }
+    return;
+  }
+  int n = 0;
+  while (n < k) {
+    for (int e = n; e < k; e++) {
+      out[e] = (int) (splitmix64(state) % (uint64_t) cols);
+    }
+    qsort(out, k, sizeof(int), compare_ints);
+    n = 0;
+    for (int e = 0; e < k; e++) {
+      if (n == 0 || out[e] != out[n - 1]) {
+        out[n++] = out[e];
+      }
+    }
+  }
+}
+
+bool sparse_generate(SparseMatrix *m, int rows, int cols, double density, DType dt, uint64_t seed) {
+  if (rows <= 0 || cols <= 0 || density < 0 || density > 1) {
+    return false;
+  }
+  int64_t *lengths = (int64_t *) malloc(((size_t) rows + 1) * sizeof(int64_t));
+  if (lengths == NULL) {
+    return false;
+  }
+  // Every row has its own generator, so rows can be generated in any order
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < rows; i++) {
+    uint64_t state = seed ^ ((uint64_t) i * 0xd1342543de82ef95ull);
+    lengths[i] = row_length(&state, cols, density);
+  }
+  int64_t nnz = 0;
+  for (int i = 0; i < rows; i++) {
+    nnz += lengths[i];
+  }
+  if (!sparse_alloc(m, rows, cols, nnz, dt)) {
+    free(lengths);
+    return false;
+  }
+  m->row_ptr[0] = 0;
+  for (int i = 0; i < rows; i++) {
+    m->row_ptr[i + 1] = m->row_ptr[i] + lengths[i];
+  }
+  free(lengths);
+  size_t esz = dtype_size(dt);
+  #pragma omp parallel for schedule(dynamic, 64)
+  for (int i = 0; i < rows; i++) {
+    uint64_t state = seed ^ ((uint64_t) i * 0xd1342543de82ef95ull);
+    int k = row_length(&state, cols, density);
+    draw_columns(&state, cols, k, m->col_idx + m->row_ptr[i]);
+    // Small integers, exact in every element type
+    for (int64_t e = m->row_ptr[i]; e < m->row_ptr[i + 1]; e++) {
+      double re = (double) (splitmix64(&state) % 255) - 127;
+      double im = (double) (splitmix64(&state) % 255) - 127;
+      dtype_set(dt, (char *) m->values + e * esz, re, im);
+    }
+  }
+  return true;
+}
+
+bool sparse_load_mtx(const char *path, DType dt, SparseMatrix *m) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Error: cannot open %s\n", path);
+    return false;
+  }
+  char line[1024];
+  char object[64], format[64], field[64], symmetry[64];
+  if (fgets(line, sizeof(line), f) == NULL ||
+      sscanf(line, "%%%%MatrixMarket %63s %63s %63s %63s", object, format, field, symmetry) != 4 ||
+      strcasecmp(object, "matrix") != 0 || strcasecmp(format, "coordinate") != 0) {
+    fprintf(stderr, "Error: %s is not a Matrix Market coordinate matrix\n", path);
+    fclose(f);
+    return false;
+  }
+  bool pattern = strcasecmp(field, "pattern") == 0;
+  bool complex = strcasecmp(field, "complex") == 0;
+  bool symmetric = strcasecmp(symmetry, "symmetric") == 0;
+  bool skew = strcasecmp(symmetry, "skew-symmetric") == 0;
+  bool hermitian = strcasecmp(symmetry, "hermitian") == 0;
+  if ((!pattern && !complex && strcasecmp(field, "real") != 0 && strcasecmp(field, "integer") != 0 &&
+       strcasecmp(field, "double") != 0) ||
+      (!symmetric && !skew && !hermitian && strcasecmp(symmetry, "general") != 0)) {
+    fprintf(stderr, "Error: unsupported Matrix Market type %s %s in %s\n", field, symmetry, path);
+    fclose(f);
+    return false;
+  }
+  long long rows = 0, cols = 0, entries = 0;
+  while (fgets(line, sizeof(line), f) != NULL && line[0] == '%') {
+  }
+  if (sscanf(line, "%lld %lld %lld", &rows, &cols, &entries) != 3 || rows <= 0 || cols <= 0 ||
+      rows > INT32_MAX || cols > INT32_MAX || entries < 0) {
+    fprintf(stderr, "Error: invalid size line in %s\n", path);
+    fclose(f);
+    return false;
+  }
+
+  // The elements are read into the transpose, bucketed by column in the order of the file, and
+  // transposed back: this sorts the columns of every row
+  size_t esz = dtype_size(dt);
+  int64_t capacity = (symmetric || skew || hermitian) ? 2 * entries : entries;
+  int *coo_i = (int *) malloc(((size_t) capacity + 1) * sizeof(int));
+  int *coo_j = (int *) malloc(((size_t) capacity + 1) * sizeof(int));
+  char *coo_v = (char *) malloc(((size_t) capacity + 1) * esz);
+  SparseMatrix at = {0};
+  bool ok = coo_i != NULL && coo_j != NULL && coo_v != NULL;
+  int64_t n = 0;
+  for (long long e = 0; ok && e < entries; e++) {
+    if (fgets(line, sizeof(line), f) == NULL) {
+      fprintf(stderr, "Error: %s ends after %lld of %lld entries\n", path, e, entries);
+      ok = false;
+      break;
+    }
+    char *ptr = line, *end;
+    long i = strtol(ptr, &end, 10);
+    long j = strtol(end, &ptr, 10);
+    double re = 1, im = 0;
+    if (!pattern) {
+      re = strtod(ptr, &end);
+      if (complex) {
+        im = strtod(end, NULL);
+      }
+    }
+    if (i < 1 || i > rows || j < 1 || j > cols) {
+      fprintf(stderr, "Error: entry %lld of %s is out of the matrix\n", e + 1, path);
+      ok = false;
+      break;
+    }
+    coo_i[n] = (int) i - 1;
+    coo_j[n] = (int) j - 1;
+    dtype_set(dt, coo_v + n * esz, re, im);
+    n++;
+    if ((symmetric || skew || hermitian) && i != j) {
+      coo_i[n] = (int) j - 1;
+      coo_j[n] = (int) i - 1;
+      dtype_set(dt, coo_v + n * esz, skew ? -re : re, skew ? -im : (hermitian ? -im : im));
+      n++;
+    }
+  }
+  fclose(f);
+  if (ok && !sparse_alloc(&at, (int) cols, (int) rows, n, dt)) {
+    ok = false;
+  }
+  if (ok) {
+    memset(at.row_ptr, 0, ((size_t) cols + 1) * sizeof(int64_t));
+    for (int64_t e = 0; e < n; e++) {
+      at.row_ptr[coo_j[e] + 1]++;
+    }
+    for (long long c = 0; c < cols; c++) {
+      at.row_ptr[c + 1] += at.row_ptr[c];
+    }
+    // at.row_ptr[c] is used as the insertion point of column c, then shifted back
+    for (int64_t e = 0; e < n; e++) {
+      int64_t pos = at.row_ptr[coo_j[e]]++;
+      at.col_idx[pos] = coo_i[e];
+      memcpy((char *) at.values + pos * esz, coo_v + e * esz, esz);
+    }
+    for (long long c = cols; c > 0; c--) {
+      at.row_ptr[c] = at.row_ptr[c - 1];
+    }
+    at.row_ptr[0] = 0;
+    ok = sparse_transpose(&at, m, 0, false);
+  }
+  free(coo_i);
+  free(coo_j);
+  free(coo_v);
+  if (at.row_ptr != NULL) {
+    sparse_free(&at);
+  }
+  return ok;
+}
+
+bool sparse_save_mtx(const char *path, const SparseMatrix *m) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "Error: cannot open %s\n", path);
+    return false;
+  }
+  bool complex = dtype_info[m->dt].complex;
+  bool integer = m->dt == DTYPE_INT8 || m->dt == DTYPE_UINT8 || m->dt == DTYPE_INT16;
+  fprintf(f, "%%%%MatrixMarket matrix coordinate %s general\n", complex ? "complex" : (integer ? "integer" : "real"));
+  fprintf(f, "%d %d %lld\n", m->rows, m->cols, (long long) m->nnz);
+  size_t esz = dtype_size(m->dt);
+  for (int i = 0; i < m->rows; i++) {
+    for (int64_t e = m->row_ptr[i]; e < m->row_ptr[i + 1]; e++) {
+      double re, im;
+      dtype_get(m->dt, (const char *) m->values + e * esz, &re, &im);
+      if (complex) {
+        fprintf(f, "%d %d %.17g %.17g\n", i + 1, m->col_idx[e] + 1, re, im);
+      } else {
+        fprintf(f, "%d %d %.17g\n", i + 1, m->col_idx[e] + 1, re);
+      }
+    }
+  }
+  return fclose(f) == 0;
+}
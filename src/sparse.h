@@ -0,0 +1,56 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+// Sparse matrices of libtranspose. Matrices are stored in CSR format; the transpose of a CSR
+// matrix in CSR format is the CSC format of the matrix, so the same routine converts CSR to CSC.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "dtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// rows x cols matrix with nnz stored elements of type dt. The column indices of row i are
+/// col_idx[row_ptr[i] .. row_ptr[i + 1] - 1], in increasing order, and values holds the elements
+/// in the same order.
+typedef struct {
+  int rows, cols;
+  int64_t nnz;
+  DType dt;
+  int64_t *row_ptr;
+  int *col_idx;
+  void *values;
+} SparseMatrix;
+
+/// Allocate the arrays of a matrix with nnz elements. Returns false if they cannot be allocated.
+bool sparse_alloc(SparseMatrix *m, int rows, int cols, int64_t nnz, DType dt);
+
+void sparse_free(SparseMatrix *m);
+
+/// Transpose `a` into `t`, which is allocated. `threads` is the number of OpenMP threads, 0 for
+/// omp_get_max_threads(). Each thread counts the columns of a band of rows of equal nnz in its
+/// own counters; a prefix sum over the columns and the threads gives every thread the position
+/// of its elements, which it then scatters. The column indices of `a` need not be sorted; the
+/// rows of `t` are sorted. Complex elements are conjugated when `conj` is set.
+bool sparse_transpose(const SparseMatrix *a, SparseMatrix *t, int threads, bool conj);
+
+/// Generate a rows x cols matrix whose rows each hold density * cols elements (rounded
+/// randomly up or down) at random distinct columns, with random values. The same seed gives the
+/// same matrix whatever the number of threads.
+bool sparse_generate(SparseMatrix *m, int rows, int cols, double density, DType dt, uint64_t seed);
+
+/// Load a Matrix Market coordinate file (real, integer, complex or pattern; general, symmetric,
+/// skew-symmetric or hermitian) into a matrix of type dt. Symmetric matrices are expanded.
+/// Prints the error and returns false on failure.
+bool sparse_load_mtx(const char *path, DType dt, SparseMatrix *m);
+
+/// Write a matrix as a general Matrix Market coordinate file.
+bool sparse_save_mtx(const char *path, const SparseMatrix *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
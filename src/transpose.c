@@ -0,0 +1,935 @@
+#include <stdbool.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "transpose.h"
+#include "kernels.h"
+
+// Matrices of a batch up to this size (source and destination) fit in the private caches of a
+// core and are transposed whole by a single thread; larger matrices are split in tiles
+#define SMALL_MATRIX_BYTES (256 * 1024)
+// Repetitions of each candidate tile size when measuring
+#define MEASURE_RUNS 3
+// The automatic tile size is halved, down to MIN_TILE, until each thread gets at least
+// TILES_PER_THREAD tiles, so that small matrices still keep all the threads busy
+#define TILES_PER_THREAD 4
+#define MIN_TILE 16
+// Tasks created per thread when the tiles are distributed as tasks
+#define TASKS_PER_THREAD 8
+
+// A tile of the source matrix, with the byte offsets of its first element in the source and of
+// the corresponding element in the destination, and its first column
+typedef struct {
+  size_t src_off, dst_off;
+  int rows, cols;
+  int col;
+} Tile;
+
+struct TransposePlan {
+  DType dt;
+  bool conj;
+  int rows, cols;
+  size_t lds, ldd;
+  int threads;
+  int tile;
+  bool untiled;
+  // Tiles covering the matrix, computed once so that executing the plan is a single loop. They
+  // are stored in the order they are scheduled in: row-major, Morton or Hilbert
+  Tile *tiles;
+  int num_tiles;
+  unsigned order;
+  // Tiles are distributed as tasks of `grain` tiles each instead of statically
+  bool tasks;
+  int grain;
+  // omatcopy plans compute dst = alpha * src^T + beta * dst
+  bool scaled;
+  double alpha, beta;
+  // Convert plans transpose float elements into elements of type `to`, int8 elements being
+  // quantised with scales[j * scale_step] for row j of the destination
+  bool convert;
+  DType to;
+  RoundMode round;
+  const float *scales;
+  int scale_step;
+  // Batched plans: number of matrices, stride between them in bytes and whether each thread
+  // transposes whole matrices, with the kernel specialised for their size when there is one
+  int batch;
+  size_t stride;
+  bool whole_matrices;
+  FixedTranspose fixed;
+  // Tiled plans: the tiles of the destination are tile x tile blocks of a layout, whose padding
+  // is zeroed after transposing the edge tiles, as when packing
+  bool zero_padding;
+};
+
+struct TransposeLayout {
+  int rows, cols;
+  int tile;
+  int tiles_i, tiles_j;
+  // Position in storage of each tile, the tiles being indexed in row-major order
+  int *slot;
+};
+
+static double wall_time(void) {
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static int max_threads(void) {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// Position of tile (ti, tj) along the Z-order curve: the bits of the two indices interleaved
+static uint64_t morton_key(uint32_t ti, uint32_t tj) {
+  uint64_t key = 0;
+  for (int b = 0; b < 32; b++) {
+    key |= (uint64_t) ((tj >> b) & 1) << (2 * b);
+    key |= (uint64_t) ((ti >> b) & 1) << (2 * b + 1);
+  }
+  return key;
+}
+
+// Position of tile (ti, tj) along the Hilbert curve filling an n x n grid, n a power of two.
+// Unlike the Z-order curve, consecutive tiles are always neighbours.
+static uint64_t hilbert_key(uint32_t n, uint32_t ti, uint32_t tj) {
+  uint64_t key = 0;
+  for (uint32_t s = n / 2; s > 0; s /= 2) {
+    uint32_t rx = (tj & s) > 0;
+    uint32_t ry = (ti & s) > 0;
+    key += (uint64_t) s * s * ((3 * rx) ^ ry);
+    // Rotate the quadrant so that the curve inside it starts and ends at the right corners
+    if (ry == 0) {
+      if (rx == 1) {
+        tj = n - 1 - tj;
+        ti = n - 1 - ti;
+      }
+      uint32_t t = tj;
+      tj = ti;
+      ti = t;
+    }
+  }
+  return key;
+}
+
+typedef struct {
+  uint64_t key;
+  int index;
+} KeyedIndex;
+
+static int compare_keyed_indices(const void *a, const void *b) {
+  uint64_t ka = ((const KeyedIndex *) a)->key;
+  uint64_t kb = ((const KeyedIndex *) b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+// Row-major indices of the tiles of a tiles_i x tiles_j grid, sorted along the Morton or
+// Hilbert curve selected by `order`
+static int *curve_order(unsigned order, int tiles_i, int tiles_j) {
+  size_t n = (size_t) tiles_i * tiles_j;
+  KeyedIndex *keyed = (KeyedIndex *) malloc(n * sizeof(KeyedIndex));
+  int *perm = (int *) malloc(n * sizeof(int));
+  if (keyed == NULL || perm == NULL) {
+    free(keyed);
+    free(perm);
+    return NULL;
+  }
+  uint32_t side = 1;
+  while (side < (uint32_t) tiles_i || side < (uint32_t) tiles_j) {
+    side *= 2;
+  }
+  for (int ti = 0; ti < tiles_i; ti++) {
+    for (int tj = 0; tj < tiles_j; tj++) {
+      KeyedIndex *k = &keyed[(size_t) ti * tiles_j + tj];
+      k->key = (order & TRANSPOSE_ORDER_HILBERT) ? hilbert_key(side, ti, tj) : morton_key(ti, tj);
+      k->index = ti * tiles_j + tj;
+    }
+  }
+  qsort(keyed, n, sizeof(KeyedIndex), compare_keyed_indices);
+  for (size_t t = 0; t < n; t++) {
+    perm[t] = keyed[t].index;
+  }
+  free(keyed);
+  return perm;
+}
+
+// Sort the tiles, generated in row-major order, along the curve selected for the plan
+static bool order_tiles(TransposePlan *plan, Tile *tiles, int tiles_i, int tiles_j) {
+  size_t n = (size_t) tiles_i * tiles_j;
+  int *perm = curve_order(plan->order, tiles_i, tiles_j);
+  Tile *sorted = (Tile *) malloc(n * sizeof(Tile));
+  if (perm == NULL || sorted == NULL) {
+    free(perm);
+    free(sorted);
+    return false;
+  }
+  for (size_t t = 0; t < n; t++) {
+    sorted[t] = tiles[perm[t]];
+  }
+  memcpy(tiles, sorted, n * sizeof(Tile));
+  free(sorted);
+  free(perm);
+  return true;
+}
+
+// Size of the elements of the destination
+static size_t dst_size(const TransposePlan *plan) {
+  return dtype_size(plan->convert ? plan->to : plan->dt);
+}
+
+// Replace the tiles of the plan
+static void set_tiles(TransposePlan *plan, Tile *tiles, int num_tiles, int tile) {
+  free(plan->tiles);
+  plan->tiles = tiles;
+  plan->num_tiles = num_tiles;
+  plan->tile = tile;
+  plan->grain = num_tiles / (TASKS_PER_THREAD * plan->threads);
+  plan->grain = plan->grain > 0 ? plan->grain : 1;
+}
+
+static bool build_tiles(TransposePlan *plan, int tile) {
+  size_t esz = dtype_size(plan->dt);
+  size_t dst_esz = dst_size(plan);
+  int tiles_i = (plan->rows + tile - 1) / tile;
+  int tiles_j = (plan->cols + tile - 1) / tile;
+  Tile *tiles = (Tile *) malloc((size_t) tiles_i * tiles_j * sizeof(Tile));
+  if (tiles == NULL) {
+    return false;
+  }
+  int n = 0;
+  for (int i = 0; i < plan->rows; i += tile) {
+    for (int j = 0; j < plan->cols; j += tile) {
+      tiles[n].src_off = ((size_t) i * plan->lds + j) * esz;
+      tiles[n].dst_off = ((size_t) j * plan->ldd + i) * dst_esz;
+      tiles[n].rows = (i + tile < plan->rows) ? tile : plan->rows - i;
+      tiles[n].cols = (j + tile < plan->cols) ? tile : plan->cols - j;
+      tiles[n].col = j;
+      n++;
+    }
+  }
+  if (plan->order != 0 && !order_tiles(plan, tiles, tiles_i, tiles_j)) {
+    free(tiles);
+    return false;
+  }
+  set_tiles(plan, tiles, n, tile);
+  return true;
+}
+
+// Default tile of the element width, halved until every thread gets TILES_PER_THREAD tiles
+static int auto_tile(int rows, int cols, DType dt, int threads) {
+  int tile = default_tile_size(dt);
+  while (tile > MIN_TILE &&
+         (size_t) ((rows + tile - 1) / tile) * ((cols + tile - 1) / tile) < (size_t) TILES_PER_THREAD * threads) {
+    tile /= 2;
+  }
+  return tile;
+}
+
+static inline void run_block(const TransposePlan *plan, const char *src, char *dst, int rows, int cols, int col) {
+  if (plan->convert) {
+    transpose_block_convert(plan->to, plan->round, (const float *) src, plan->lds, dst, plan->ldd, rows, cols,
+                            plan->scales + (size_t) col * plan->scale_step, plan->scale_step);
+  } else if (plan->scaled) {
+    transpose_block_scaled(plan->dt, src, plan->lds, dst, plan->ldd, rows, cols, plan->alpha, plan->beta);
+  } else {
+    transpose_block(plan->dt, plan->conj, src, plan->lds, dst, plan->ldd, rows, cols);
+  }
+}
+
+// Zero the elements of the tile x tile destination tile `dst` outside its first rows x cols
+static void zero_tile_padding(const TransposePlan *plan, char *dst, int rows, int cols) {
+  size_t esz = dst_size(plan);
+  size_t tile_row = (size_t) plan->tile * esz;
+  for (int i = 0; i < rows; i++) {
+    memset(dst + i * tile_row + cols * esz, 0, (plan->tile - cols) * esz);
+  }
+  memset(dst + rows * tile_row, 0, (plan->tile - rows) * tile_row);
+}
+
+static inline void run_tile(const TransposePlan *plan, const Tile *tile, const char *src, char *dst) {
+  run_block(plan, src + tile->src_off, dst + tile->dst_off, tile->rows, tile->cols, tile->col);
+  if (plan->zero_padding && (tile->rows < plan->tile || tile->cols < plan->tile)) {
+    zero_tile_padding(plan, dst + tile->dst_off, tile->cols, tile->rows);
+  }
+}
+
+// Transpose one matrix, sharing its tiles among the threads of the enclosing parallel region
+// if there is one
+static void run_tiles(const TransposePlan *plan, const char *src, char *dst) {
+  #pragma omp for schedule(static) nowait
+  for (int t = 0; t < plan->num_tiles; t++) {
+    run_tile(plan, &plan->tiles[t], src, dst);
+  }
+}
+
+// Transpose one matrix, one thread creating tasks of `grain` consecutive tiles that all the
+// threads of the team execute
+static void run_tile_tasks(const TransposePlan *plan, const char *src, char *dst) {
+  #pragma omp single
+  #pragma omp taskloop grainsize(plan->grain)
+  for (int t = 0; t < plan->num_tiles; t++) {
+    run_tile(plan, &plan->tiles[t], src, dst);
+  }
+}
+
+static void execute_single(const TransposePlan *plan, const char *src, char *dst) {
+  if (plan->untiled) {
+    run_block(plan, src, dst, plan->rows, plan->cols, 0);
+  } else if (plan->threads == 1) {
+    run_tiles(plan, src, dst);
+  } else if (plan->tasks) {
+    #pragma omp parallel num_threads(plan->threads)
+    run_tile_tasks(plan, src, dst);
+  } else {
+    #pragma omp parallel num_threads(plan->threads)
+    run_tiles(plan, src, dst);
+  }
+}
+
+// Time the candidate tile sizes on scratch buffers and keep the fastest. Falls back to the
+// default tile size when the scratch buffers cannot be allocated.
+static bool measure_tile(TransposePlan *plan) {
+  size_t esz = dtype_size(plan->dt);
+  char *src = (char *) calloc((size_t) plan->rows * plan->lds, esz);
+  char *dst = (char *) calloc((size_t) plan->cols * plan->ldd, dst_size(plan));
+  bool ok = true;
+  int best_tile = plan->tile;
+  if (src != NULL && dst != NULL) {
+    static const int candidates[] = {16, 32, 64, 128, 256};
+    double best_time = -1;
+    for (size_t c = 0; c < sizeof(candidates) / sizeof(candidates[0]); c++) {
+      if (candidates[c] > 2 * plan->rows && candidates[c] > 2 * plan->cols) {
+        break;
+      }
+      if (!build_tiles(plan, candidates[c])) {
+        ok = false;
+        break;
+      }
+      double elapsed = -1;
+      for (int r = 0; r < MEASURE_RUNS; r++) {
+        double start = wall_time();
+        execute_single(plan, src, dst);
+        double t = wall_time() - start;
+        if (elapsed < 0 || t < elapsed) {
+          elapsed = t;
+        }
+      }
+      if (best_time < 0 || elapsed < best_time) {
+        best_time = elapsed;
+        best_tile = candidates[c];
+      }
+    }
+  }
+  free(src);
+  free(dst);
+  return ok && build_tiles(plan, best_tile);
+}
+
+// Create a plan computing dst = alpha * src^T + beta * dst, which is a plain transpose for
+// alpha 1 and beta 0
+static TransposePlan *create_plan(int rows, int cols, size_t lds, size_t ldd, DType dt, int threads,
+                                  int tile, unsigned flags, double alpha, double beta) {
+  if (rows <= 0 || cols <= 0 || (unsigned) dt >= DTYPE_COUNT || threads < 0 || tile < 0) {
+    return NULL;
+  }
+  lds = lds == 0 ? (size_t) cols : lds;
+  ldd = ldd == 0 ? (size_t) rows : ldd;
+  if (lds < (size_t) cols || ldd < (size_t) rows) {
+    return NULL;
+  }
+  TransposePlan *plan = (TransposePlan *) calloc(1, sizeof(TransposePlan));
+  if (plan == NULL) {
+    return NULL;
+  }
+  plan->dt = dt;
+  plan->conj = (flags & TRANSPOSE_CONJ) && dtype_info[dt].complex;
+  plan->rows = rows;
+  plan->cols = cols;
+  plan->lds = lds;
+  plan->ldd = ldd;
+  plan->threads = threads == 0 ? max_threads() : threads;
+  plan->untiled = (flags & TRANSPOSE_UNTILED) != 0;
+  plan->order = flags & (TRANSPOSE_ORDER_MORTON | TRANSPOSE_ORDER_HILBERT);
+  plan->tasks = (flags & TRANSPOSE_TASKS) != 0;
+  // A plain copy needs no arithmetic and keeps the bit-moving kernels
+  plan->scaled = alpha != 1 || beta != 0;
+  plan->alpha = alpha;
+  plan->beta = beta;
+  plan->tile = tile == 0 ? auto_tile(rows, cols, dt, plan->threads) : tile;
+  if (!plan->untiled) {
+    bool ok = (flags & TRANSPOSE_MEASURE) && tile == 0 ? measure_tile(plan) : build_tiles(plan, plan->tile);
+    if (!ok) {
+      transpose_plan_destroy(plan);
+      return NULL;
+    }
+  }
+  return plan;
+}
+
+TransposePlan *transpose_plan_create(int rows, int cols, size_t lds, size_t ldd, DType dt,
+                                     int threads, int tile, unsigned flags) {
+  return create_plan(rows, cols, lds, ldd, dt, threads, tile, flags, 1, 0);
+}
+
+TransposePlan *transpose_plan_batched(int N, int batch, size_t stride, DType dt, int threads,
+                                      unsigned flags) {
+  if (batch <= 0) {
+    return NULL;
+  }
+  // Threads mostly share the work across matrices, so the tiles need not shrink with the thread
+  // count, and the tile loop of each matrix is too short to benefit from tasks
+  TransposePlan *plan = transpose_plan_create(N, N, 0, 0, dt, threads, default_tile_size(dt),
+                                              flags & ~(TRANSPOSE_UNTILED | TRANSPOSE_TASKS));
+  if (plan == NULL) {
+    return NULL;
+  }
+  stride = stride == 0 ? (size_t) N * N : stride;
+  if (stride < (size_t) N * N) {
+    transpose_plan_destroy(plan);
+    return NULL;
+  }
+  plan->batch = batch;
+  plan->stride = stride * dtype_size(dt);
+  plan->whole_matrices = 2 * (size_t) N * N * dtype_size(dt) <= SMALL_MATRIX_BYTES;
+  plan->fixed = fixed_transpose_kernel(N);
+  return plan;
+}
+
+TransposePlan *transpose_plan_omatcopy(int rows, int cols, double alpha, size_t lda, double beta,
+                                       size_t ldb, DType dt, int threads, unsigned flags) {
+  if (dt != DTYPE_FLOAT && dt != DTYPE_DOUBLE) {
+    return NULL;
+  }
+  return create_plan(rows, cols, lda, ldb, dt, threads, 0, flags & ~TRANSPOSE_CONJ, alpha, beta);
+}
+
+TransposePlan *transpose_plan_convert(int rows, int cols, size_t lds, size_t ldd, DType to,
+                                     const float *scales, int threads, unsigned flags) {
+  if ((to != DTYPE_BF16 && to != DTYPE_HALF && to != DTYPE_INT8) || (to == DTYPE_INT8 && scales == NULL)) {
+    return NULL;
+  }
+  // Scales may only be valid at execution, so the tile size is not measured
+  TransposePlan *plan = create_plan(rows, cols, lds, ldd, DTYPE_FLOAT, threads, 0,
+                                    flags & ~(TRANSPOSE_CONJ | TRANSPOSE_MEASURE), 1, 0);
+  if (plan == NULL) {
+    return NULL;
+  }
+  plan->convert = true;
+  plan->to = to;
+  plan->round = (flags & TRANSPOSE_ROUND_ZERO) ? ROUND_TOWARD_ZERO : ROUND_NEAREST_EVEN;
+  plan->scales = scales;
+  plan->scale_step = (flags & TRANSPOSE_SCALE_PER_ROW) ? 1 : 0;
+  // The destination offsets of the tiles depend on the converted element size
+  if (!plan->untiled && !build_tiles(plan, plan->tile)) {
+    transpose_plan_destroy(plan);
+    return NULL;
+  }
+  return plan;
+}
+
+TransposeLayout *transpose_layout_create(int rows, int cols, int tile, unsigned flags) {
+  if (rows <= 0 || cols <= 0 || tile <= 0) {
+    return NULL;
+  }
+  int tiles_i = (rows + tile - 1) / tile;
+  int tiles_j = (cols + tile - 1) / tile;
+  if ((size_t) tiles_i * tiles_j > INT_MAX) {
+    return NULL;
+  }
+  TransposeLayout *layout = (TransposeLayout *) calloc(1, sizeof(TransposeLayout));
+  if (layout == NULL) {
+    return NULL;
+  }
+  layout->rows = rows;
+  layout->cols = cols;
+  layout->tile = tile;
+  layout->tiles_i = tiles_i;
+  layout->tiles_j = tiles_j;
+  layout->slot = (int *) malloc((size_t) tiles_i * tiles_j * sizeof(int));
+  unsigned order = flags & (TRANSPOSE_ORDER_MORTON | TRANSPOSE_ORDER_HILBERT);
+  int *perm = order != 0 ? curve_order(order, tiles_i, tiles_j) : NULL;
+  if (layout->slot == NULL || (order != 0 && perm == NULL)) {
+    free(perm);
+    transpose_layout_destroy(layout);
+    return NULL;
+  }
+  for (int t = 0; t < tiles_i * tiles_j; t++) {
+    layout->slot[perm != NULL ? perm[t] : t] = t;
+  }
+  free(perm);
+  return layout;
+}
+
+size_t transpose_layout_size(const TransposeLayout *layout) {
+  return (size_t) layout->tiles_i * layout->tiles_j * layout->tile * layout->tile;
+}
+
+size_t transpose_layout_offset(const TransposeLayout *layout, int i, int j) {
+  int tile = layout->tile;
+  size_t slot = layout->slot[(i / tile) * layout->tiles_j + j / tile];
+  return slot * tile * tile + (size_t) (i % tile) * tile + j % tile;
+}
+
+// Copy between the tiles of the layout and a row-major matrix with row stride ld, in either
+// direction. The padding of the edge tiles is zeroed when packing.
+static void copy_layout(const TransposeLayout *layout, DType dt, const char *src, char *dst, size_t ld,
+                        int threads, bool pack) {
+  size_t esz = dtype_size(dt);
+  int tile = layout->tile;
+  size_t tile_row = (size_t) tile * esz;
+  threads = threads == 0 ? max_threads() : threads;
+  #pragma omp parallel for schedule(static) num_threads(threads) if (threads > 1)
+  for (int t = 0; t < layout->tiles_i * layout->tiles_j; t++) {
+    int ti = t / layout->tiles_j, tj = t % layout->tiles_j;
+    int rows = (ti + 1) * tile <= layout->rows ? tile : layout->rows - ti * tile;
+    int cols = (tj + 1) * tile <= layout->cols ? tile : layout->cols - tj * tile;
+    size_t tiled = (size_t) layout->slot[t] * tile * tile_row;
+    size_t row_major = ((size_t) ti * tile * ld + (size_t) tj * tile) * esz;
+    for (int i = 0; i < rows; i++) {
+      if (pack) {
+        memcpy(dst + tiled + i * tile_row, src + row_major + i * ld * esz, cols * esz);
+        memset(dst + tiled + i * tile_row + cols * esz, 0, (tile - cols) * esz);
+      } else {
+        memcpy(dst + row_major + i * ld * esz, src + tiled + i * tile_row, cols * esz);
+      }
+    }
+    if (pack) {
+      memset(dst + tiled + rows * tile_row, 0, (tile - rows) * tile_row);
+    }
+  }
+}
+
+void transpose_layout_pack(const TransposeLayout *layout, DType dt, const void *src, size_t lds, void *dst,
+                           int threads) {
+  lds = lds == 0 ? (size_t) layout->cols : lds;
+  copy_layout(layout, dt, (const char *) src, (char *) dst, lds, threads, true);
+}
+
+void transpose_layout_unpack(const TransposeLayout *layout, DType dt, const void *src, void *dst, size_t ldd,
+                             int threads) {
+  ldd = ldd == 0 ? (size_t) layout->cols : ldd;
+  copy_layout(layout, dt, (const char *) src, (char *) dst, ldd, threads, false);
+}
+
+void transpose_layout_destroy(TransposeLayout *layout) {
+  if (layout != NULL) {
+    free(layout->slot);
+    free(layout);
+  }
+}
+
+TransposePlan *transpose_plan_tiled(const TransposeLayout *src, const TransposeLayout *dst, DType dt,
+                                    int threads, unsigned flags) {
+  if (src == NULL || dst == NULL || dst->rows != src->cols || dst->cols != src->rows || dst->tile != src->tile) {
+    return NULL;
+  }
+  // Start from the plan of a single contiguous tile and replace its tiles with those of the
+  // layouts: tile (ti, tj) of src is transposed into tile (tj, ti) of dst
+  int tile = src->tile;
+  TransposePlan *plan = create_plan(tile, tile, 0, 0, dt, threads, tile,
+                                    (flags & (TRANSPOSE_CONJ | TRANSPOSE_TASKS)) | TRANSPOSE_UNTILED, 1, 0);
+  if (plan == NULL) {
+    return NULL;
+  }
+  int num_tiles = src->tiles_i * src->tiles_j;
+  Tile *tiles = (Tile *) malloc((size_t) num_tiles * sizeof(Tile));
+  if (tiles == NULL) {
+    transpose_plan_destroy(plan);
+    return NULL;
+  }
+  size_t tile_bytes = (size_t) tile * tile * dtype_size(dt);
+  for (int t = 0; t < num_tiles; t++) {
+    int ti = t / src->tiles_j, tj = t % src->tiles_j;
+    // Tiles are scheduled in the order they are stored in src
+    Tile *s = &tiles[src->slot[t]];
+    s->src_off = src->slot[t] * tile_bytes;
+    s->dst_off = dst->slot[tj * dst->tiles_j + ti] * tile_bytes;
+    s->rows = (ti + 1) * tile <= src->rows ? tile : src->rows - ti * tile;
+    s->cols = (tj + 1) * tile <= src->cols ? tile : src->cols - tj * tile;
+    s->col = tj * tile;
+  }
+  plan->rows = src->rows;
+  plan->cols = src->cols;
+  plan->untiled = false;
+  plan->zero_padding = true;
+  set_tiles(plan, tiles, num_tiles, tile);
+  return plan;
+}
+
+void transpose_somatcopy(int rows, int cols, float alpha, const float *A, size_t lda, float beta,
+                         float *B, size_t ldb) {
+  TransposePlan *plan = transpose_plan_omatcopy(rows, cols, alpha, lda, beta, ldb, DTYPE_FLOAT, 0, 0);
+  if (plan != NULL) {
+    transpose_execute(plan, A, B);
+    transpose_plan_destroy(plan);
+  }
+}
+
+void transpose_domatcopy(int rows, int cols, double alpha, const double *A, size_t lda, double beta,
+                         double *B, size_t ldb) {
+  TransposePlan *plan = transpose_plan_omatcopy(rows, cols, alpha, lda, beta, ldb, DTYPE_DOUBLE, 0, 0);
+  if (plan != NULL) {
+    transpose_execute(plan, A, B);
+    transpose_plan_destroy(plan);
+  }
+}
+
+// Transpose the matrices of a batch, `src_base` and `dst_base` being used when the pointer
+// arrays are NULL
+static void execute_batch(const TransposePlan *plan, const char *src_base, char *dst_base,
+                          const void *const *src, void *const *dst) {
+  if (plan->whole_matrices) {
+    // Batch granularity: each thread transposes whole matrices
+    #pragma omp parallel for schedule(static) num_threads(plan->threads) if (plan->threads > 1)
+    for (int k = 0; k < plan->batch; k++) {
+      const char *s = src != NULL ? (const char *) src[k] : src_base + (size_t) k * plan->stride;
+      char *d = dst != NULL ? (char *) dst[k] : dst_base + (size_t) k * plan->stride;
+      if (plan->fixed != NULL) {
+        plan->fixed(plan->dt, plan->conj, s, d);
+      } else {
+        for (int t = 0; t < plan->num_tiles; t++) {
+          run_tile(plan, &plan->tiles[t], s, d);
+        }
+      }
+    }
+  } else {
+    // Tile granularity: the tiles of each matrix are shared among the threads. Matrices are
+    // independent, so threads move on to the next one without waiting for the others
+    #pragma omp parallel num_threads(plan->threads) if (plan->threads > 1)
+    for (int k = 0; k < plan->batch; k++) {
+      const char *s = src != NULL ? (const char *) src[k] : src_base + (size_t) k * plan->stride;
+      char *d = dst != NULL ? (char *) dst[k] : dst_base + (size_t) k * plan->stride;
+      run_tiles(plan, s, d);
+    }
+  }
+}
+
+void transpose_execute(const TransposePlan *plan, const void *src, void *dst) {
+  if (plan->batch > 0) {
+    execute_batch(plan, (const char *) src, (char *) dst, NULL, NULL);
+  } else {
+    execute_single(plan, (const char *) src, (char *) dst);
+  }
+}
+
+void transpose_execute_batch_ptrs(const TransposePlan *plan, const void *const *src, void *const *dst) {
+  if (plan->batch > 0) {
+    execute_batch(plan, NULL, NULL, src, dst);
+  } else {
+    execute_single(plan, (const char *) src[0], (char *) dst[0]);
+  }
+}
+
+int transpose_plan_tile(const TransposePlan *plan) {
+  return plan->untiled ? 0 : plan->tile;
+}
+
+void transpose_plan_destroy(TransposePlan *plan) {
+  if (plan != NULL) {
+    free(plan->tiles);
+    free(plan);
+  }
+}
+
+struct TransposeView {
+  const char *src;
+  size_t lds;
+  DType dt;
+  bool conj;
+  // Shape of the transpose and of its tiles
+  int rows, cols;
+  int tile, tiles_i, tiles_j;
+  // Cache of `capacity` transposed tiles of tile x tile elements. slot_of gives the slot of each
+  // tile of the transpose (-1 when it is not cached) and tile_of the tile of each slot (-1 when
+  // the slot is free)
+  int capacity;
+  char *cache;
+  int *slot_of, *tile_of;
+  // Slots from the most recently used (head) to the least recently used (tail)
+  int *prev, *next;
+  int head, tail;
+  // Threads copying out of each slot, which is not evicted while they do, and whether its tile
+  // has been transposed
+  int *pins;
+  int *ready;
+  TransposeViewStats stats;
+#ifdef _OPENMP
+  omp_lock_t lock;
+#endif
+};
+
+static void view_lock(TransposeView *view) {
+#ifdef _OPENMP
+  omp_set_lock(&view->lock);
+#else
+  (void) view;
+#endif
+}
+
+static void view_unlock(TransposeView *view) {
+#ifdef _OPENMP
+  omp_unset_lock(&view->lock);
+#else
+  (void) view;
+#endif
+}
+
+TransposeView *transpose_view_create(const void *src, int rows, int cols, size_t lds, DType dt, int tile,
+                                     int cache_tiles, unsigned flags) {
+  if (src == NULL || rows <= 0 || cols <= 0 || (unsigned) dt >= DTYPE_COUNT || tile < 0 || cache_tiles < 0) {
+    return NULL;
+  }
+  lds = lds == 0 ? (size_t) cols : lds;
+  if (lds < (size_t) cols) {
+    return NULL;
+  }
+  tile = tile == 0 ? default_tile_size(dt) : tile;
+  // The transpose has cols rows and rows columns
+  int tiles_i = (cols + tile - 1) / tile;
+  int tiles_j = (rows + tile - 1) / tile;
+  if ((size_t) tiles_i * tiles_j > INT_MAX) {
+    return NULL;
+  }
+  TransposeView *view = (TransposeView *) calloc(1, sizeof(TransposeView));
+  if (view == NULL) {
+    return NULL;
+  }
+  view->src = (const char *) src;
+  view->lds = lds;
+  view->dt = dt;
+  view->conj = (flags & TRANSPOSE_CONJ) && dtype_info[dt].complex;
+  view->rows = cols;
+  view->cols = rows;
+  view->tile = tile;
+  view->tiles_i = tiles_i;
+  view->tiles_j = tiles_j;
+  int num_tiles = tiles_i * tiles_j;
+  int capacity = cache_tiles;
+  if (capacity == 0) {
+    capacity = 2 * tiles_j > 2 * max_threads() ? 2 * tiles_j : 2 * max_threads();
+  }
+  view->capacity = capacity = capacity < num_tiles ? capacity : num_tiles;
+  view->cache = (char *) malloc((size_t) capacity * tile * tile * dtype_size(dt));
+  view->slot_of = (int *) malloc((size_t) num_tiles * sizeof(int));
+  view->tile_of = (int *) malloc((size_t) capacity * sizeof(int));
+  view->prev = (int *) malloc((size_t) capacity * sizeof(int));
+  view->next = (int *) malloc((size_t) capacity * sizeof(int));
+  view->pins = (int *) calloc(capacity, sizeof(int));
+  view->ready = (int *) calloc(capacity, sizeof(int));
+  if (view->cache == NULL || view->slot_of == NULL || view->tile_of == NULL || view->prev == NULL ||
+      view->next == NULL || view->pins == NULL || view->ready == NULL) {
+    free(view->cache);
+    free(view->slot_of);
+    free(view->tile_of);
+    free(view->prev);
+    free(view->next);
+    free(view->pins);
+    free(view->ready);
+    free(view);
+    return NULL;
+  }
+  for (int t = 0; t < num_tiles; t++) {
+    view->slot_of[t] = -1;
+  }
+  for (int s = 0; s < capacity; s++) {
+    view->tile_of[s] = -1;
+    view->prev[s] = s - 1;
+    view->next[s] = s + 1 < capacity ? s + 1 : -1;
+  }
+  view->head = 0;
+  view->tail = capacity - 1;
+  view->stats.total_tiles = (size_t) num_tiles;
+  view->stats.cache_bytes = (size_t) capacity * tile * tile * dtype_size(dt);
+#ifdef _OPENMP
+  omp_init_lock(&view->lock);
+#endif
+  return view;
+}
+
+// Move slot s to the head of the least recently used list. Called with the lock held.
+static void touch_slot(TransposeView *view, int s) {
+  if (view->head == s) {
+    return;
+  }
+  view->next[view->prev[s]] = view->next[s];
+  if (view->next[s] >= 0) {
+    view->prev[view->next[s]] = view->prev[s];
+  } else {
+    view->tail = view->prev[s];
+  }
+  view->prev[s] = -1;
+  view->next[s] = view->head;
+  view->prev[view->head] = s;
+  view->head = s;
+}
+
+// Pin the slot holding tile t of the transpose so that it is not evicted while it is read. On a
+// miss the tile is assigned the least recently used slot that no thread is reading and `load`
+// is set: the caller transposes the tile into the slot with load_tile. Returns -1 when every
+// slot is being read.
+static int pin_tile(TransposeView *view, int t, bool prefetch, bool *load) {
+  *load = false;
+  view_lock(view);
+  int s = view->slot_of[t];
+  if (s >= 0) {
+    view->stats.hits += prefetch ? 0 : 1;
+  } else {
+    s = view->tail;
+    while (s >= 0 && view->pins[s] > 0) {
+      s = view->prev[s];
+    }
+    if (s < 0) {
+      view->stats.bypasses++;
+      view_unlock(view);
+      return -1;
+    }
+    if (view->tile_of[s] >= 0) {
+      view->slot_of[view->tile_of[s]] = -1;
+      view->stats.evictions++;
+    }
+    view->tile_of[s] = t;
+    view->slot_of[t] = s;
+    #pragma omp atomic write seq_cst
+    view->ready[s] = 0;
+    view->stats.misses++;
+    view->stats.prefetched += prefetch ? 1 : 0;
+    *load = true;
+  }
+  view->pins[s]++;
+  touch_slot(view, s);
+  view_unlock(view);
+  return s;
+}
+
+static void unpin_slot(TransposeView *view, int s) {
+  view_lock(view);
+  view->pins[s]--;
+  view_unlock(view);
+}
+
+static char *slot_data(const TransposeView *view, int s) {
+  return view->cache + (size_t) s * view->tile * view->tile * dtype_size(view->dt);
+}
+
+// Transpose tile t into slot s and publish it to the threads waiting for it
+static void load_tile(TransposeView *view, int t, int s) {
+  int tile = view->tile;
+  int ti = t / view->tiles_j, tj = t % view->tiles_j;
+  int rows = (ti + 1) * tile <= view->rows ? tile : view->rows - ti * tile;
+  int cols = (tj + 1) * tile <= view->cols ? tile : view->cols - tj * tile;
+  // Rows of the tile are columns of the source and the other way round
+  const char *src = view->src + ((size_t) tj * tile * view->lds + (size_t) ti * tile) * dtype_size(view->dt);
+  transpose_block(view->dt, view->conj, src, view->lds, slot_data(view, s), tile, cols, rows);
+  #pragma omp atomic write seq_cst
+  view->ready[s] = 1;
+}
+
+// Wait until the thread that missed the tile of slot s has transposed it
+static void wait_tile(TransposeView *view, int s) {
+  int ready = 0;
+  while (!ready) {
+    #pragma omp atomic read seq_cst
+    ready = view->ready[s];
+  }
+}
+
+void transpose_view_read(TransposeView *view, int i0, int j0, int rows, int cols, void *out, size_t ldo) {
+  if (i0 < 0 || j0 < 0 || rows <= 0 || cols <= 0 || i0 + rows > view->rows || j0 + cols > view->cols) {
+    return;
+  }
+  ldo = ldo == 0 ? (size_t) cols : ldo;
+  size_t esz = dtype_size(view->dt);
+  int tile = view->tile;
+  for (int ti = i0 / tile; ti <= (i0 + rows - 1) / tile; ti++) {
+    for (int tj = j0 / tile; tj <= (j0 + cols - 1) / tile; tj++) {
+      // Part of the window inside the tile
+      int r0 = i0 > ti * tile ? i0 : ti * tile;
+      int r1 = i0 + rows < (ti + 1) * tile ? i0 + rows : (ti + 1) * tile;
+      int c0 = j0 > tj * tile ? j0 : tj * tile;
+      int c1 = j0 + cols < (tj + 1) * tile ? j0 + cols : (tj + 1) * tile;
+      char *dst = (char *) out + ((size_t) (r0 - i0) * ldo + (c0 - j0)) * esz;
+      bool load;
+      int t = ti * view->tiles_j + tj;
+      int s = pin_tile(view, t, false, &load);
+      if (s < 0) {
+        // No slot is free: transpose the part of the window from the source
+        const char *src = view->src + ((size_t) c0 * view->lds + r0) * esz;
+        transpose_block(view->dt, view->conj, src, view->lds, dst, ldo, c1 - c0, r1 - r0);
+        continue;
+      }
+      if (load) {
+        load_tile(view, t, s);
+      } else {
+        wait_tile(view, s);
+      }
+      const char *data = slot_data(view, s) + ((size_t) (r0 - ti * tile) * tile + (c0 - tj * tile)) * esz;
+      for (int r = 0; r < r1 - r0; r++) {
+        memcpy(dst + (size_t) r * ldo * esz, data + (size_t) r * tile * esz, (size_t) (c1 - c0) * esz);
+      }
+      unpin_slot(view, s);
+    }
+  }
+}
+
+void transpose_view_read_row(TransposeView *view, int i, int j0, int count, void *out) {
+  transpose_view_read(view, i, j0, 1, count, out, 0);
+}
+
+void transpose_view_prefetch(TransposeView *view, int i0, int j0, int rows, int cols, int threads) {
+  if (i0 < 0 || j0 < 0 || rows <= 0 || cols <= 0 || i0 + rows > view->rows || j0 + cols > view->cols) {
+    return;
+  }
+  int tile = view->tile;
+  int ti0 = i0 / tile, tj0 = j0 / tile;
+  int tiles_j = (j0 + cols - 1) / tile - tj0 + 1;
+  int count = ((i0 + rows - 1) / tile - ti0 + 1) * tiles_j;
+  // Tiles beyond the capacity would evict the first ones
+  count = count < view->capacity ? count : view->capacity;
+  threads = threads == 0 ? max_threads() : threads;
+  #pragma omp parallel for schedule(dynamic) num_threads(threads) if (threads > 1)
+  for (int k = 0; k < count; k++) {
+    bool load;
+    int t = (ti0 + k / tiles_j) * view->tiles_j + tj0 + k % tiles_j;
+    int s = pin_tile(view, t, true, &load);
+    if (s >= 0) {
+      if (load) {
+        load_tile(view, t, s);
+      }
+      unpin_slot(view, s);
+    }
+  }
+}
+
+void transpose_view_stats(TransposeView *view, TransposeViewStats *stats) {
+  view_lock(view);
+  *stats = view->stats;
+  view_unlock(view);
+}
+
+void transpose_view_destroy(TransposeView *view) {
+  if (view != NULL) {
+#ifdef _OPENMP
+    omp_destroy_lock(&view->lock);
+#endif
+    free(view->cache);
+    free(view->slot_of);
+    free(view->tile_of);
+    free(view->prev);
+    free(view->next);
+    free(view->pins);
+    free(view->ready);
+    free(view);
+  }
+}
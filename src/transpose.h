@@ -0,0 +1,155 @@
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+// Public interface of libtranspose. A plan is created once for a shape, element type and number
+// of threads; creating it selects the kernels, tunes the tile size and precomputes the work
+// distribution, so that executing it repeatedly has almost no overhead.
+
+#include <stddef.h>
+#include "dtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Conjugate complex elements while transposing
+#define TRANSPOSE_CONJ (1u << 0)
+// Sweep the whole matrix with the micro-kernel instead of transposing it tile by tile
+#define TRANSPOSE_UNTILED (1u << 1)
+// Time the candidate tile sizes on scratch buffers when the plan is created and keep the fastest
+#define TRANSPOSE_MEASURE (1u << 2)
+// Order in which the tiles are handed to the threads: row-major by default, or along a Morton
+// (Z-order) or Hilbert curve, so that each thread works on a compact region of both matrices
+#define TRANSPOSE_ORDER_MORTON (1u << 3)
+#define TRANSPOSE_ORDER_HILBERT (1u << 4)
+// Distribute the tiles as OpenMP tasks, which idle threads steal, instead of a static schedule
+#define TRANSPOSE_TASKS (1u << 5)
+// Conversion plans: round toward zero instead of to nearest even
+#define TRANSPOSE_ROUND_ZERO (1u << 6)
+// Conversion plans to int8: one scale per row of the destination instead of one for the matrix
+#define TRANSPOSE_SCALE_PER_ROW (1u << 7)
+
+typedef struct TransposePlan TransposePlan;
+typedef struct TransposeLayout TransposeLayout;
+
+/// Plan the out-of-place transpose of a rows x cols matrix with row stride `lds` into a
+/// cols x rows matrix with row stride `ldd`. Strides are in elements, 0 selects the dense
+/// stride. `threads` is the number of OpenMP threads, 0 uses omp_get_max_threads(). `tile`
+/// fixes the tile side, 0 lets the plan choose it: the default tile of the element width, halved
+/// until every thread gets several tiles. Returns NULL on invalid arguments.
+TransposePlan *transpose_plan_create(int rows, int cols, size_t lds, size_t ldd, DType dt,
+                                     int threads, int tile, unsigned flags);
+
+/// Plan the transpose of `batch` N x N matrices. With transpose_execute the matrices are stored
+/// contiguously, the start of consecutive matrices being `stride` elements apart (0 for N * N);
+/// with transpose_execute_batch_ptrs they are given by arrays of pointers.
+TransposePlan *transpose_plan_batched(int N, int batch, size_t stride, DType dt, int threads,
+                                      unsigned flags);
+
+/// Plan B = alpha * A^T + beta * B in the style of BLAS omatcopy, for float and double elements.
+/// A is a rows x cols window with row stride `lda` (0 for cols) and B a cols x rows window with
+/// row stride `ldb` (0 for rows), so that sub-panels of larger matrices can be transposed in
+/// place within their buffers. B is not read when beta is 0. Returns NULL for other types.
+TransposePlan *transpose_plan_omatcopy(int rows, int cols, double alpha, size_t lda, double beta,
+                                       size_t ldb, DType dt, int threads, unsigned flags);
+
+/// One-shot omatcopy of float and double matrices with all the OpenMP threads: plan, execute
+/// and destroy. Plan once with transpose_plan_omatcopy to transpose many windows of one shape.
+void transpose_somatcopy(int rows, int cols, float alpha, const float *A, size_t lda, float beta,
+                         float *B, size_t ldb);
+void transpose_domatcopy(int rows, int cols, double alpha, const double *A, size_t lda, double beta,
+                         double *B, size_t ldb);
+
+/// Plan the transpose of a rows x cols float matrix into a cols x rows matrix of bf16, half or
+/// int8 elements, converting them in the same pass instead of transposing and converting in
+/// two sweeps. int8 elements are divided by their scale, rounded and saturated to [-128, 127];
+/// `scales` holds one scale, or cols scales with TRANSPOSE_SCALE_PER_ROW, and is read when the
+/// plan is executed. Rounding is to nearest even, or toward zero with TRANSPOSE_ROUND_ZERO.
+TransposePlan *transpose_plan_convert(int rows, int cols, size_t lds, size_t ldd, DType to,
+                                     const float *scales, int threads, unsigned flags);
+
+/// Tiled storage of a rows x cols matrix: tile x tile tiles are stored contiguously, row-major
+/// inside the tile, one after the other in row-major order or, with TRANSPOSE_ORDER_MORTON or
+/// TRANSPOSE_ORDER_HILBERT, along that curve. Edge tiles are padded to tile x tile elements.
+TransposeLayout *transpose_layout_create(int rows, int cols, int tile, unsigned flags);
+
+/// Elements of the tiled storage, padding included.
+size_t transpose_layout_size(const TransposeLayout *layout);
+
+/// Offset in elements of element (i, j) of the matrix in the tiled storage.
+size_t transpose_layout_offset(const TransposeLayout *layout, int i, int j);
+
+/// Convert a row-major matrix with row stride `lds` (0 for cols) to tiled storage, and back to
+/// a row-major matrix with row stride `ldd`, one tile per iteration of a parallel loop over
+/// `threads` threads (0 for all of them).
+void transpose_layout_pack(const TransposeLayout *layout, DType dt, const void *src, size_t lds, void *dst,
+                           int threads);
+void transpose_layout_unpack(const TransposeLayout *layout, DType dt, const void *src, void *dst, size_t ldd,
+                             int threads);
+
+void transpose_layout_destroy(TransposeLayout *layout);
+
+/// Plan the transpose of a matrix in tiled storage `src` into the tiled storage `dst` of its
+/// transpose, which must have the same tile side. Every tile is transposed contiguously into
+/// its mirrored tile, so the transpose is a permutation of tiles with no strided access. The
+/// padding of the edge tiles of dst is zeroed, as by transpose_layout_pack.
+TransposePlan *transpose_plan_tiled(const TransposeLayout *src, const TransposeLayout *dst, DType dt,
+                                    int threads, unsigned flags);
+
+/// Transpose `src` into `dst`. The buffers must not overlap.
+void transpose_execute(const TransposePlan *plan, const void *src, void *dst);
+
+/// Transpose the matrices `src[k]` into `dst[k]` of a batched plan.
+void transpose_execute_batch_ptrs(const TransposePlan *plan, const void *const *src, void *const *dst);
+
+/// Tile side selected for the plan.
+int transpose_plan_tile(const TransposePlan *plan);
+
+void transpose_plan_destroy(TransposePlan *plan);
+
+typedef struct TransposeView TransposeView;
+
+/// Counters of a view. Every tile read is a hit, a miss (the tile is transposed into the cache,
+/// evicting the least recently used tile when the cache is full) or a bypass (every tile of the
+/// cache is being read by other threads, the elements are read from the source directly).
+typedef struct {
+  size_t hits, misses, evictions, bypasses;
+  // Tiles transposed by transpose_view_prefetch, included in misses
+  size_t prefetched;
+  // Tiles of the whole transpose, transposed once each by a full materialisation
+  size_t total_tiles;
+  // Bytes of the cache
+  size_t cache_bytes;
+} TransposeViewStats;
+
+/// Lazy view of the transpose of the rows x cols matrix `src` with row stride `lds` (0 for
+/// cols), which must stay unchanged while the view is used. Nothing is transposed up front:
+/// reading an element transposes the tile x tile tile of the transpose holding it (0 for the
+/// default tile of the element width) into a cache of `cache_tiles` tiles (0 for two bands of
+/// tiles of the transpose and at least two tiles per thread), managed least recently used.
+/// Conjugates with TRANSPOSE_CONJ. Returns NULL on invalid arguments.
+TransposeView *transpose_view_create(const void *src, int rows, int cols, size_t lds, DType dt, int tile,
+                                     int cache_tiles, unsigned flags);
+
+/// Copy the rows x cols window at (i0, j0) of the transpose into `out` with row stride `ldo`
+/// (0 for cols); windows outside the transpose are ignored. Only the tiles of the window are
+/// transposed. Thread-safe: threads reading the same tile wait for one of them to transpose it,
+/// and tiles being read are never evicted.
+void transpose_view_read(TransposeView *view, int i0, int j0, int rows, int cols, void *out, size_t ldo);
+
+/// Copy elements j0 .. j0 + count - 1 of row i of the transpose (column i of the source).
+void transpose_view_read_row(TransposeView *view, int i, int j0, int count, void *out);
+
+/// Hint that the rows x cols window at (i0, j0) of the transpose will be read: its tiles are
+/// transposed now by `threads` threads (0 for all of them), up to the capacity of the cache.
+void transpose_view_prefetch(TransposeView *view, int i0, int j0, int rows, int cols, int threads);
+
+void transpose_view_stats(TransposeView *view, TransposeViewStats *stats);
+
+void transpose_view_destroy(TransposeView *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
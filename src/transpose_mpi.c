@@ -0,0 +1,828 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "transpose_mpi.h"
+#include "mpi_utils.h"
+#include "kernels.h"
+
+// Initial size in bytes of the chunks in which encoded data is exchanged
+#define WIRE_CHUNK 4096
+
+// Window of the N x N matrix transposed by a rank: a band of rows, or a block of the grid
+typedef struct {
+  int row0, rows;
+  int col0, cols;
+} Piece;
+
+struct TransposeMPIPlan {
+  MPI_Comm comm;
+  int root, rank, size;
+  int N;
+  DType dt;
+  bool conj;
+  TransposeMPIStrategy strategy;
+  MPI_Datatype elem_type;
+  // Side of the process grid and of its blocks for TRANSPOSE_MPI_BLOCKS
+  int grid, block;
+  // Datatype of a local row, and datatypes of the pieces of the full matrix sent and received
+  // by the root
+  MPI_Datatype row_type, send_type, recv_type;
+  // Displacements and counts of the root, in extents of send_type and recv_type
+  int *count, *send_disp, *recv_disp;
+  // Rows exchanged by this rank
+  int local_rows;
+  int first_row;
+  // Local buffers: the whole matrix on non-root ranks for TRANSPOSE_MPI_BROADCAST, the local
+  // band for TRANSPOSE_MPI_SCATTER, the local block and its transpose for TRANSPOSE_MPI_BLOCKS
+  char *local, *local_t;
+  TransposePlan *local_plan;
+
+  // Wire format (TRANSPOSE_WIRE_* flag, 0 for native elements). The root encodes the piece of
+  // every rank while extracting it from the matrix, the ranks transpose their piece and send it
+  // back encoded, and the root decodes the transposed pieces straight into their position.
+  unsigned wire;
+  size_t wire_esz;
+  Piece piece;
+  // Encoded data is exchanged as chunks of wire_chunk bytes (wire_type), so that the counts and
+  // offsets passed to MPI fit in int for matrices of any size
+  size_t wire_chunk;
+  MPI_Datatype wire_type;
+  // Root: encoded pieces sent and received, with their sizes in bytes, and their counts and
+  // offsets in chunks
+  char *wire_send, *wire_recv;
+  uint64_t *wire_send_bytes, *wire_recv_bytes;
+  int *wire_send_count, *wire_send_disp, *wire_recv_count, *wire_recv_disp;
+  // Received encoded data (the whole matrix for TRANSPOSE_MPI_BROADCAST) and transposed piece
+  char *wire_local, *wire_local_t;
+  uint64_t wire_local_bytes;
+  // TRANSPOSE_WIRE_SHUFFLE: byte planes, decoded piece (or matrix) and its transpose
+  char *shuffled, *plain, *plain_t;
+  TransposePlan *wire_plan;
+  // Bytes exchanged between the root and the other ranks in the last execution
+  size_t wire_bytes, native_bytes;
+
+  // TRANSPOSE_MPI_HIERARCHICAL: ranks sharing memory with this one, and their first ranks (the
+  // leaders, the root being the first of both communicators). Only leaders talk to the root;
+  // the pieces of a node are stored one after the other in a window shared by its ranks.
+  MPI_Comm node_comm, leader_comm;
+  int node_rank, nodes;
+  MPI_Win win;
+  // Node input (the whole matrix for TRANSPOSE_MPI_BROADCAST) and transposed pieces, and the
+  // position of the piece of this rank, in rows of piece.cols elements
+  char *shared_in, *shared_out;
+  int node_rows, node_first;
+  // Root: rows of each node and their offset, offset of the piece of each rank, buffers of the
+  // pieces packed by node and of the transposed pieces
+  int *node_count, *node_disp, *piece_disp;
+  char *packed, *gathered;
+
+  // TRANSPOSE_MPI_TILED: the root stores the matrices in this layout, whose tiles are the blocks
+  bool tiled;
+  TransposeLayout *layout;
+};
+
+// Split the N rows into bands of at most one row of difference
+static void band_rows(int N, int size, int i, int *first, int *rows) {
+  int remainder = N % size;
+  *first = i * (N / size) + (i < remainder ? i : remainder);
+  *rows = N / size + (i < remainder ? 1 : 0);
+}
+
+static Piece rank_piece(const TransposeMPIPlan *plan, int rank) {
+  Piece p;
+  if (plan->strategy == TRANSPOSE_MPI_BLOCKS) {
+    p.row0 = (rank / plan->grid) * plan->block;
+    p.col0 = (rank % plan->grid) * plan->block;
+    p.rows = p.cols = plan->block;
+  } else {
+    band_rows(plan->N, plan->size, rank, &p.row0, &p.rows);
+    p.col0 = 0;
+    p.cols = plan->N;
+  }
+  return p;
+}
+
+static size_t piece_elems(Piece p) {
+  return (size_t) p.rows * p.cols;
+}
+
+// Datatype of a column of the N x N matrix, resized so that consecutive columns are one
+// element apart
+static MPI_Datatype create_column_type(int N, DType dt, MPI_Datatype elem_type) {
+  MPI_Datatype column_type, resized_type;
+  MPI_Type_vector(N, 1, N, elem_type, &column_type);
+  MPI_Type_create_resized(column_type, 0, dtype_size(dt), &resized_type);
+  MPI_Type_commit(&resized_type);
+  MPI_Type_free(&column_type);
+  return resized_type;
+}
+
+static bool plan_bands(TransposeMPIPlan *plan) {
+  int N = plan->N;
+  size_t esz = dtype_size(plan->dt);
+  band_rows(N, plan->size, plan->rank, &plan->first_row, &plan->local_rows);
+  plan->row_type = create_row_type(N, plan->elem_type);
+  if (plan->rank == plan->root) {
+    plan->recv_type = create_column_type(N, plan->dt, plan->elem_type);
+    if (plan->strategy == TRANSPOSE_MPI_SCATTER) {
+      plan->send_type = create_row_type(N, plan->elem_type);
+    }
+    plan->count = (int *) calloc(plan->size, sizeof(int));
+    plan->send_disp = (int *) calloc(plan->size, sizeof(int));
+    for (int i = 0; i < plan->size; ++i) {
+      band_rows(N, plan->size, i, &plan->send_disp[i], &plan->count[i]);
+    }
+    plan->recv_disp = plan->send_disp;
+  } else if (plan->strategy == TRANSPOSE_MPI_BROADCAST) {
+    plan->local = (char *) malloc((size_t) N * N * esz);
+    if (plan->local == NULL) {
+      return false;
+    }
+  }
+  if (plan->strategy == TRANSPOSE_MPI_SCATTER && plan->local_rows > 0) {
+    plan->local = (char *) malloc((size_t) plan->local_rows * N * esz);
+    if (plan->local == NULL) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Check that the processes form a square grid whose side divides N
+static bool plan_grid(TransposeMPIPlan *plan) {
+  int grid = (int) sqrt(plan->size);
+  while (grid * grid > plan->size) {
+    grid--;
+  }
+  while ((grid + 1) * (grid + 1) <= plan->size) {
+    grid++;
+  }
+  if (grid * grid != plan->size) {
+    if (plan->rank == plan->root) {
+      printf("Number of threads must be a square!\n");
+    }
+    return false;
+  }
+  if (plan->N % grid != 0) {
+    if (plan->rank == plan->root) {
+      printf("Matrix size must be divisible by sqrt(size)!\n");
+    }
+    return false;
+  }
+  plan->grid = grid;
+  plan->block = plan->N / grid;
+  return true;
+}
+
+static bool plan_blocks(TransposeMPIPlan *plan, int tile, unsigned flags) {
+  int N = plan->N;
+  int grid = plan->grid;
+  int block = plan->block;
+  size_t esz = dtype_size(plan->dt);
+  plan->local_rows = block;
+  // The local block is exchanged as rows to keep the element count below INT_MAX
+  plan->row_type = create_row_type(block, plan->elem_type);
+  if (plan->rank == plan->root && plan->tiled) {
+    // The blocks are the tiles of the layout, contiguous in memory, and block (i, j) of the
+    // transpose is the transpose of block (j, i)
+    plan->layout = transpose_layout_create(N, N, block, flags);
+    if (plan->layout == NULL) {
+      return false;
+    }
+    MPI_Type_contiguous(block, plan->row_type, &plan->send_type);
+    MPI_Type_commit(&plan->send_type);
+    plan->recv_type = plan->send_type;
+    plan->count = (int *) calloc(plan->size, sizeof(int));
+    plan->send_disp = (int *) calloc(plan->size, sizeof(int));
+    plan->recv_disp = (int *) calloc(plan->size, sizeof(int));
+    size_t block_elems = (size_t) block * block;
+    for (int i = 0; i < plan->size; ++i) {
+      plan->count[i] = 1;
+      plan->send_disp[i] = (int) (transpose_layout_offset(plan->layout, (i / grid) * block, (i % grid) * block) / block_elems);
+      plan->recv_disp[i] = (int) (transpose_layout_offset(plan->layout, (i % grid) * block, (i / grid) * block) / block_elems);
+    }
+  } else if (plan->rank == plan->root) {
+    MPI_Datatype block_type;
+    int array_elements[] = {N, N};
+    int array_of_subsizes[] = {block, block};
+    int array_of_starts[] = {0, 0};
+    MPI_Type_create_subarray(2, array_elements, array_of_subsizes, array_of_starts, MPI_ORDER_C, plan->elem_type, &block_type);
+    MPI_Type_create_resized(block_type, 0, block * esz, &plan->send_type);
+    MPI_Type_commit(&plan->send_type);
+    MPI_Type_free(&block_type);
+    plan->recv_type = plan->send_type;
+    plan->count = (int *) calloc(plan->size, sizeof(int));
+    plan->send_disp = (int *) calloc(plan->size, sizeof(int));
+    plan->recv_disp = (int *) calloc(plan->size, sizeof(int));
+    for (int i = 0; i < plan->size; ++i) {
+      plan->count[i] = 1;
+      plan->send_disp[i] = (i % grid) + (i / grid) * N;
+      plan->recv_disp[i] = (i % grid) * N + (i / grid);
+    }
+  }
+  plan->local = (char *) malloc((size_t) block * block * esz);
+  plan->local_t = (char *) malloc((size_t) block * block * esz);
+  // Each process transposes its block with a single thread
+  plan->local_plan = transpose_plan_create(block, block, 0, 0, plan->dt, 1, tile, flags);
+  return plan->local != NULL && plan->local_t != NULL && plan->local_plan != NULL;
+}
+
+// Largest encoded size of `bytes` bytes of native elements
+static size_t wire_bound(const TransposeMPIPlan *plan, size_t bytes) {
+  if (plan->wire == TRANSPOSE_WIRE_SHUFFLE) {
+    return compressBound(bytes);
+  }
+  return bytes / dtype_size(plan->dt) * plan->wire_esz;
+}
+
+// Chunks of the plan holding `bytes` bytes
+static size_t wire_chunks(const TransposeMPIPlan *plan, size_t bytes) {
+  return (bytes + plan->wire_chunk - 1) / plan->wire_chunk;
+}
+
+// Buffer of a piece; with fewer rows than ranks some pieces are empty, for which malloc(0) may
+// return NULL
+static void *malloc_piece(size_t bytes) {
+  return malloc(bytes > 0 ? bytes : 1);
+}
+
+static bool plan_wire(TransposeMPIPlan *plan, int tile, unsigned flags) {
+  int N = plan->N;
+  size_t esz = dtype_size(plan->dt);
+  bool broadcast = plan->strategy == TRANSPOSE_MPI_BROADCAST;
+  bool is_root = plan->rank == plan->root;
+  if (plan->wire != TRANSPOSE_WIRE_SHUFFLE && plan->dt != DTYPE_FLOAT) {
+    if (is_root) {
+      printf("Error: the bf16 and half wire formats need float elements\n");
+    }
+    return false;
+  }
+  plan->wire_esz = plan->wire == TRANSPOSE_WIRE_SHUFFLE ? esz : 2;
+  plan->piece = rank_piece(plan, plan->rank);
+  size_t piece_bytes = piece_elems(plan->piece) * esz;
+  size_t matrix_bytes = (size_t) N * N * esz;
+
+  // Every piece starts on a chunk, and the chunk is doubled until the chunks of all the pieces
+  // can be counted with an int
+  plan->wire_chunk = WIRE_CHUNK;
+  size_t total;
+  do {
+    total = broadcast ? wire_chunks(plan, wire_bound(plan, matrix_bytes)) : 0;
+    for (int k = 0; k < plan->size; k++) {
+      total += wire_chunks(plan, wire_bound(plan, piece_elems(rank_piece(plan, k)) * esz));
+    }
+    plan->wire_chunk *= total > INT_MAX ? 2 : 1;
+  } while (total > INT_MAX);
+  plan->wire_type = create_row_type((int) plan->wire_chunk, MPI_BYTE);
+
+  if (is_root) {
+    plan->wire_send_bytes = (uint64_t *) calloc(plan->size, sizeof(uint64_t));
+    plan->wire_recv_bytes = (uint64_t *) calloc(plan->size, sizeof(uint64_t));
+    plan->wire_send_count = (int *) calloc(plan->size, sizeof(int));
+    plan->wire_send_disp = (int *) calloc(plan->size, sizeof(int));
+    plan->wire_recv_count = (int *) calloc(plan->size, sizeof(int));
+    plan->wire_recv_disp = (int *) calloc(plan->size, sizeof(int));
+    size_t send_total = 0, recv_total = 0;
+    for (int k = 0; k < plan->size; k++) {
+      size_t chunks = wire_chunks(plan, wire_bound(plan, piece_elems(rank_piece(plan, k)) * esz));
+      plan->wire_send_disp[k] = (int) send_total;
+      plan->wire_recv_disp[k] = (int) recv_total;
+      send_total += chunks;
+      recv_total += chunks;
+    }
+    if (broadcast) {
+      send_total = wire_chunks(plan, wire_bound(plan, matrix_bytes));
+    }
+    plan->wire_send = (char *) malloc_piece(send_total * plan->wire_chunk);
+    plan->wire_recv = (char *) malloc_piece(recv_total * plan->wire_chunk);
+    if (plan->wire_send == NULL || plan->wire_recv == NULL) {
+      return false;
+    }
+  }
+  size_t local_bytes = broadcast ? matrix_bytes : piece_bytes;
+  plan->wire_local_bytes = wire_bound(plan, local_bytes);
+  plan->wire_local = (char *) malloc_piece(wire_chunks(plan, wire_bound(plan, local_bytes)) * plan->wire_chunk);
+  plan->wire_local_t = (char *) malloc_piece(wire_chunks(plan, wire_bound(plan, piece_bytes)) * plan->wire_chunk);
+  if (plan->wire_local == NULL || plan->wire_local_t == NULL) {
+    return false;
+  }
+  // The piece is transposed in its encoded form for bf16 and half, which are plain 2-byte
+  // elements, and decoded first when compressed
+  size_t lds = broadcast ? (size_t) N : (size_t) plan->piece.cols;
+  if (plan->wire == TRANSPOSE_WIRE_SHUFFLE) {
+    size_t largest = local_bytes;
+    if (is_root && !broadcast) {
+      for (int k = 0; k < plan->size; k++) {
+        size_t bytes = piece_elems(rank_piece(plan, k)) * esz;
+        largest = bytes > largest ? bytes : largest;
+      }
+    }
+    plan->shuffled = (char *) malloc_piece(largest);
+    plan->plain = (char *) malloc_piece(local_bytes);
+    plan->plain_t = (char *) malloc_piece(piece_bytes);
+    if (plan->shuffled == NULL || plan->plain == NULL || plan->plain_t == NULL) {
+      return false;
+    }
+  }
+  // With more processes than rows some bands are empty
+  if (plan->piece.rows == 0) {
+    return true;
+  }
+  DType wire_dt = plan->wire == TRANSPOSE_WIRE_SHUFFLE ? plan->dt : DTYPE_HALF;
+  plan->wire_plan = transpose_plan_create(plan->piece.rows, plan->piece.cols, lds, 0, wire_dt, 1, tile, flags);
+  return plan->wire_plan != NULL;
+}
+
+static bool plan_hierarchical(TransposeMPIPlan *plan, int tile, unsigned flags) {
+  int N = plan->N;
+  size_t esz = dtype_size(plan->dt);
+  bool broadcast = plan->strategy == TRANSPOSE_MPI_BROADCAST;
+  bool is_root = plan->rank == plan->root;
+  if (plan->wire != 0) {
+    if (is_root) {
+      printf("Error: wire formats cannot be combined with hierarchical collectives\n");
+    }
+    return false;
+  }
+  // Sorting the root first makes it the leader of its node and the root of the leaders
+  int key = is_root ? -1 : plan->rank;
+  MPI_Comm_split_type(plan->comm, MPI_COMM_TYPE_SHARED, key, MPI_INFO_NULL, &plan->node_comm);
+  MPI_Comm_rank(plan->node_comm, &plan->node_rank);
+  MPI_Comm_split(plan->comm, plan->node_rank == 0 ? 0 : MPI_UNDEFINED, key, &plan->leader_comm);
+  int node = 0;
+  if (plan->leader_comm != MPI_COMM_NULL) {
+    MPI_Comm_rank(plan->leader_comm, &node);
+    MPI_Comm_size(plan->leader_comm, &plan->nodes);
+  }
+  MPI_Bcast(&node, 1, MPI_INT, 0, plan->node_comm);
+
+  // The pieces of all strategies have the same width, and are exchanged as rows of that width
+  plan->piece = rank_piece(plan, plan->rank);
+  int cols = plan->piece.cols;
+  plan->row_type = create_row_type(cols, plan->elem_type);
+  plan->node_first = 0;
+  MPI_Exscan(&plan->piece.rows, &plan->node_first, 1, MPI_INT, MPI_SUM, plan->node_comm);
+  if (plan->node_rank == 0) {
+    plan->node_first = 0;
+  }
+  MPI_Allreduce(&plan->piece.rows, &plan->node_rows, 1, MPI_INT, MPI_SUM, plan->node_comm);
+
+  // The root packs the pieces of each node at the position they have in the node window
+  int where[2] = {node, plan->node_first};
+  int *all_where = is_root ? (int *) malloc(2 * plan->size * sizeof(int)) : NULL;
+  MPI_Gather(where, 2, MPI_INT, all_where, 2, MPI_INT, plan->root, plan->comm);
+  if (is_root) {
+    plan->node_count = (int *) calloc(plan->nodes, sizeof(int));
+    plan->node_disp = (int *) calloc(plan->nodes, sizeof(int));
+    plan->piece_disp = (int *) calloc(plan->size, sizeof(int));
+    for (int k = 0; k < plan->size; k++) {
+      plan->node_count[all_where[2 * k]] += rank_piece(plan, k).rows;
+    }
+    for (int n = 1; n < plan->nodes; n++) {
+      plan->node_disp[n] = plan->node_disp[n - 1] + plan->node_count[n - 1];
+    }
+    for (int k = 0; k < plan->size; k++) {
+      plan->piece_disp[k] = plan->node_disp[all_where[2 * k]] + all_where[2 * k + 1];
+    }
+    free(all_where);
+  }
+
+  size_t in_elems = broadcast ? (size_t) N * N : (size_t) plan->node_rows * cols;
+  size_t out_elems = (size_t) plan->node_rows * cols;
+  MPI_Aint bytes = plan->node_rank == 0 ? (MPI_Aint) ((in_elems + out_elems) * esz) : 0;
+  MPI_Aint size;
+  int disp_unit;
+  char *base;
+  MPI_Win_allocate_shared(bytes, 1, MPI_INFO_NULL, plan->node_comm, &base, &plan->win);
+  MPI_Win_shared_query(plan->win, 0, &size, &disp_unit, &plan->shared_in);
+  plan->shared_out = plan->shared_in + in_elems * esz;
+  // The window is accessed with loads and stores only, in a passive epoch open for the life of
+  // the plan and synchronised at each handoff by node_handoff
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, plan->win);
+
+  if (is_root) {
+    size_t total = 0;
+    for (int k = 0; k < plan->size; k++) {
+      total += piece_elems(rank_piece(plan, k));
+    }
+    plan->packed = broadcast ? NULL : (char *) malloc(total * esz);
+    plan->gathered = (char *) malloc(total * esz);
+    if ((!broadcast && plan->packed == NULL) || plan->gathered == NULL) {
+      return false;
+    }
+  }
+  if (plan->piece.rows == 0) {
+    return true;
+  }
+  size_t lds = broadcast ? (size_t) N : (size_t) cols;
+  plan->local_plan = transpose_plan_create(plan->piece.rows, cols, lds, 0, plan->dt, 1, tile, flags);
+  return plan->local_plan != NULL;
+}
+
+TransposeMPIPlan *transpose_mpi_plan_create(MPI_Comm comm, int root, int N, DType dt,
+                                            TransposeMPIStrategy strategy, int tile, unsigned flags) {
+  TransposeMPIPlan *plan = (TransposeMPIPlan *) calloc(1, sizeof(TransposeMPIPlan));
+  if (plan == NULL) {
+    return NULL;
+  }
+  plan->comm = comm;
+  plan->root = root;
+  MPI_Comm_rank(comm, &plan->rank);
+  MPI_Comm_size(comm, &plan->size);
+  plan->N = N;
+  plan->dt = dt;
+  plan->conj = (flags & TRANSPOSE_CONJ) && dtype_info[dt].complex;
+  plan->strategy = strategy;
+  plan->elem_type = dtype_mpi_type(dt);
+  plan->row_type = plan->send_type = plan->recv_type = plan->wire_type = MPI_DATATYPE_NULL;
+  plan->wire = flags & (TRANSPOSE_WIRE_BF16 | TRANSPOSE_WIRE_HALF | TRANSPOSE_WIRE_SHUFFLE);
+  plan->node_comm = plan->leader_comm = MPI_COMM_NULL;
+  plan->win = MPI_WIN_NULL;
+  plan->tiled = (flags & TRANSPOSE_MPI_TILED) != 0;
+
+  bool ok = N > 0;
+  if (ok && plan->tiled && (strategy != TRANSPOSE_MPI_BLOCKS || plan->wire != 0 || (flags & TRANSPOSE_MPI_HIERARCHICAL))) {
+    if (plan->rank == root) {
+      printf("Error: the tiled layout is only supported by the blocked strategy with native collectives\n");
+    }
+    ok = false;
+  }
+  if (ok && strategy == TRANSPOSE_MPI_BLOCKS) {
+    ok = plan_grid(plan);
+  }
+  if (ok && (flags & TRANSPOSE_MPI_HIERARCHICAL)) {
+    ok = plan_hierarchical(plan, tile, flags & ~TRANSPOSE_MPI_HIERARCHICAL);
+  } else if (ok && plan->wire != 0) {
+    ok = plan_wire(plan, tile, flags & ~(TRANSPOSE_WIRE_BF16 | TRANSPOSE_WIRE_HALF | TRANSPOSE_WIRE_SHUFFLE));
+  } else if (ok) {
+    ok = strategy == TRANSPOSE_MPI_BLOCKS ? plan_blocks(plan, tile, flags & ~TRANSPOSE_MPI_TILED) : plan_bands(plan);
+  }
+  // The plan is only usable if it could be created on every rank
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_C_BOOL, MPI_LAND, comm);
+  if (!ok) {
+    transpose_mpi_plan_destroy(plan);
+    return NULL;
+  }
+  return plan;
+}
+
+// Split the rows x cols window `src` (row stride ld) of esz-byte elements into esz planes holding
+// byte b of every element, so that the similar bytes of neighbouring elements compress together
+static void shuffle_window(const char *src, size_t ld, int rows, int cols, size_t esz, char *planes) {
+  size_t n = (size_t) rows * cols;
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      const char *e = src + ((size_t) i * ld + j) * esz;
+      size_t k = (size_t) i * cols + j;
+      for (size_t b = 0; b < esz; b++) {
+        planes[b * n + k] = e[b];
+      }
+    }
+  }
+}
+
+static void unshuffle_window(const char *planes, int rows, int cols, size_t esz, char *dst, size_t ld) {
+  size_t n = (size_t) rows * cols;
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      char *e = dst + ((size_t) i * ld + j) * esz;
+      size_t k = (size_t) i * cols + j;
+      for (size_t b = 0; b < esz; b++) {
+        e[b] = planes[b * n + k];
+      }
+    }
+  }
+}
+
+// Encode the rows x cols window `src` (row stride ld) into `out`, returning the encoded size
+static size_t encode_window(const TransposeMPIPlan *plan, const char *src, size_t ld, int rows, int cols, char *out) {
+  size_t esz = dtype_size(plan->dt);
+  if (plan->wire == TRANSPOSE_WIRE_SHUFFLE) {
+    size_t bytes = (size_t) rows * cols * esz;
+    shuffle_window(src, ld, rows, cols, esz, plan->shuffled);
+    uLongf out_bytes = compressBound(bytes);
+    int ret = compress2((Bytef *) out, &out_bytes, (const Bytef *) plan->shuffled, bytes, 1);
+    if (ret != Z_OK) {
+      fprintf(stderr, "Error: compression of a %d x %d piece failed: %s\n", rows, cols, zError(ret));
+      MPI_Abort(plan->comm, 1);
+    }
+    return out_bytes;
+  }
+  for (int i = 0; i < rows; i++) {
+    const float *row = (const float *) src + (size_t) i * ld;
+    uint16_t *packed = (uint16_t *) out + (size_t) i * cols;
+    int c = 0;
+    for (; c + 8 <= cols; c += 8) {
+      if (plan->wire == TRANSPOSE_WIRE_BF16) {
+        convert_row_bf16(row + c, packed + c, 8, 1, ROUND_NEAREST_EVEN);
+      } else {
+        convert_row_half(row + c, packed + c, 8, 1, ROUND_NEAREST_EVEN);
+      }
+    }
+    if (plan->wire == TRANSPOSE_WIRE_BF16) {
+      convert_row_bf16(row + c, packed + c, cols - c, 1, ROUND_NEAREST_EVEN);
+    } else {
+      convert_row_half(row + c, packed + c, cols - c, 1, ROUND_NEAREST_EVEN);
+    }
+  }
+  return (size_t) rows * cols * plan->wire_esz;
+}
+
+// Decode `in` (`bytes` bytes) into the rows x cols window `dst` with row stride ld
+static void decode_window(const TransposeMPIPlan *plan, const char *in, size_t bytes, int rows, int cols, char *dst,
+                          size_t ld) {
+  size_t esz = dtype_size(plan->dt);
+  if (plan->wire == TRANSPOSE_WIRE_SHUFFLE) {
+    uLongf expected = (size_t) rows * cols * esz, out_bytes = expected;
+    int ret = uncompress((Bytef *) plan->shuffled, &out_bytes, (const Bytef *) in, bytes);
+    if (ret != Z_OK || out_bytes != expected) {
+      fprintf(stderr, "Error: decompression of a %d x %d piece failed: %s\n", rows, cols,
+              ret != Z_OK ? zError(ret) : "unexpected size");
+      MPI_Abort(plan->comm, 1);
+    }
+    unshuffle_window(plan->shuffled, rows, cols, esz, dst, ld);
+    return;
+  }
+  for (int i = 0; i < rows; i++) {
+    const uint16_t *packed = (const uint16_t *) in + (size_t) i * cols;
+    float *row = (float *) dst + (size_t) i * ld;
+    if (plan->wire == TRANSPOSE_WIRE_BF16) {
+      widen_row_bf16(packed, row, cols);
+    } else {
+      widen_row_half(packed, row, cols);
+    }
+  }
+}
+
+static void execute_wire(TransposeMPIPlan *plan, const char *src, char *dst) {
+  int N = plan->N;
+  size_t esz = dtype_size(plan->dt);
+  bool is_root = plan->rank == plan->root;
+  bool broadcast = plan->strategy == TRANSPOSE_MPI_BROADCAST;
+  bool shuffle = plan->wire == TRANSPOSE_WIRE_SHUFFLE;
+  Piece p = plan->piece;
+
+  // The root encodes the pieces while extracting them from the matrix
+  uint64_t local_bytes = plan->wire_local_bytes;
+  char *received = is_root && broadcast ? plan->wire_send : plan->wire_local;
+  if (broadcast) {
+    if (is_root) {
+      local_bytes = encode_window(plan, src, N, N, N, plan->wire_send);
+    }
+    if (shuffle) {
+      MPI_Bcast(&local_bytes, 1, MPI_UINT64_T, plan->root, plan->comm);
+    }
+    MPI_Bcast(received, (int) wire_chunks(plan, local_bytes), plan->wire_type, plan->root, plan->comm);
+  } else {
+    if (is_root) {
+      for (int k = 0; k < plan->size; k++) {
+        Piece q = rank_piece(plan, k);
+        plan->wire_send_bytes[k] = encode_window(plan, src + ((size_t) q.row0 * N + q.col0) * esz, N, q.rows, q.cols,
+                                                 plan->wire_send + (size_t) plan->wire_send_disp[k] * plan->wire_chunk);
+        plan->wire_send_count[k] = (int) wire_chunks(plan, plan->wire_send_bytes[k]);
+      }
+    }
+    if (shuffle) {
+      MPI_Scatter(plan->wire_send_bytes, 1, MPI_UINT64_T, &local_bytes, 1, MPI_UINT64_T, plan->root, plan->comm);
+    }
+    MPI_Scatterv(plan->wire_send, plan->wire_send_count, plan->wire_send_disp, plan->wire_type,
+                 received, (int) wire_chunks(plan, local_bytes), plan->wire_type, plan->root, plan->comm);
+  }
+
+  // Transpose the local piece: bf16 and half directly in their 2-byte encoding
+  uint64_t out_bytes;
+  if (shuffle) {
+    int rows = broadcast ? N : p.rows;
+    size_t ld = broadcast ? (size_t) N : (size_t) p.cols;
+    decode_window(plan, received, local_bytes, rows, p.cols, plan->plain, ld);
+    if (p.rows > 0) {
+      transpose_execute(plan->wire_plan, plan->plain + (broadcast ? (size_t) p.row0 * N * esz : 0), plan->plain_t);
+    }
+    out_bytes = encode_window(plan, plan->plain_t, p.rows, p.cols, p.rows, plan->wire_local_t);
+  } else {
+    if (p.rows > 0) {
+      transpose_execute(plan->wire_plan, received + (broadcast ? (size_t) p.row0 * N * 2 : 0), plan->wire_local_t);
+    }
+    out_bytes = piece_elems(p) * 2;
+  }
+
+  // Gather the transposed pieces and decode them straight into their position
+  if (shuffle) {
+    MPI_Gather(&out_bytes, 1, MPI_UINT64_T, plan->wire_recv_bytes, 1, MPI_UINT64_T, plan->root, plan->comm);
+  }
+  if (is_root) {
+    for (int k = 0; k < plan->size; k++) {
+      plan->wire_recv_bytes[k] = shuffle ? plan->wire_recv_bytes[k] : piece_elems(rank_piece(plan, k)) * 2;
+      plan->wire_recv_count[k] = (int) wire_chunks(plan, plan->wire_recv_bytes[k]);
+    }
+  }
+  MPI_Gatherv(plan->wire_local_t, (int) wire_chunks(plan, out_bytes), plan->wire_type, plan->wire_recv,
+              plan->wire_recv_count, plan->wire_recv_disp, plan->wire_type, plan->root, plan->comm);
+  if (is_root) {
+    plan->wire_bytes = plan->native_bytes = 0;
+    for (int k = 0; k < plan->size; k++) {
+      Piece q = rank_piece(plan, k);
+      decode_window(plan, plan->wire_recv + (size_t) plan->wire_recv_disp[k] * plan->wire_chunk, plan->wire_recv_bytes[k],
+                    q.cols, q.rows, dst + ((size_t) q.col0 * N + q.row0) * esz, N);
+      // The pieces travel as whole chunks, so their padding is counted
+      if (k != plan->root) {
+        size_t chunks = wire_chunks(plan, plan->wire_recv_bytes[k]) +
+                        wire_chunks(plan, broadcast ? local_bytes : plan->wire_send_bytes[k]);
+        plan->wire_bytes += chunks * plan->wire_chunk;
+        plan->native_bytes += piece_elems(q) * esz + (broadcast ? (size_t) N * N : piece_elems(q)) * esz;
+      }
+    }
+  }
+}
+
+// Make the stores of every rank of the node to the shared window visible to the others
+static void node_handoff(TransposeMPIPlan *plan) {
+  MPI_Win_sync(plan->win);
+  MPI_Barrier(plan->node_comm);
+  MPI_Win_sync(plan->win);
+}
+
+static void execute_hierarchical(TransposeMPIPlan *plan, const char *src, char *dst) {
+  int N = plan->N;
+  size_t esz = dtype_size(plan->dt);
+  bool is_root = plan->rank == plan->root;
+  bool broadcast = plan->strategy == TRANSPOSE_MPI_BROADCAST;
+  int cols = plan->piece.cols;
+  size_t row_bytes = (size_t) cols * esz;
+
+  // One message from the root to each leader, which receives the pieces of its node in the
+  // shared window
+  if (is_root && !broadcast) {
+    for (int k = 0; k < plan->size; k++) {
+      Piece q = rank_piece(plan, k);
+      char *packed = plan->packed + plan->piece_disp[k] * row_bytes;
+      for (int i = 0; i < q.rows; i++) {
+        memcpy(packed + i * row_bytes, src + ((size_t) (q.row0 + i) * N + q.col0) * esz, row_bytes);
+      }
+    }
+  }
+  if (plan->leader_comm != MPI_COMM_NULL) {
+    if (broadcast) {
+      if (is_root) {
+        memcpy(plan->shared_in, src, (size_t) N * N * esz);
+      }
+      bcast_large(plan->shared_in, (size_t) N * N, plan->elem_type, 0, plan->leader_comm);
+    } else {
+      MPI_Scatterv(plan->packed, plan->node_count, plan->node_disp, plan->row_type,
+                   plan->shared_in, plan->node_rows, plan->row_type, 0, plan->leader_comm);
+    }
+  }
+  node_handoff(plan);
+
+  // Every rank transposes its piece from the window into the window
+  if (plan->piece.rows > 0) {
+    const char *in = plan->shared_in + (broadcast ? (size_t) plan->piece.row0 * N * esz : plan->node_first * row_bytes);
+    transpose_execute(plan->local_plan, in, plan->shared_out + plan->node_first * row_bytes);
+  }
+  node_handoff(plan);
+
+  // One message from each leader back to the root, which places the transposed pieces
+  if (plan->leader_comm != MPI_COMM_NULL) {
+    MPI_Gatherv(plan->shared_out, plan->node_rows, plan->row_type,
+                plan->gathered, plan->node_count, plan->node_disp, plan->row_type, 0, plan->leader_comm);
+  }
+  if (is_root) {
+    for (int k = 0; k < plan->size; k++) {
+      Piece q = rank_piece(plan, k);
+      const char *t = plan->gathered + plan->piece_disp[k] * row_bytes;
+      for (int j = 0; j < q.cols; j++) {
+        memcpy(dst + ((size_t) (q.col0 + j) * N + q.row0) * esz, t + (size_t) j * q.rows * esz, (size_t) q.rows * esz);
+      }
+    }
+    plan->native_bytes = 0;
+    for (int n = 1; n < plan->nodes; n++) {
+      size_t node_bytes = plan->node_count[n] * row_bytes;
+      plan->native_bytes += node_bytes + (broadcast ? (size_t) N * N * esz : node_bytes);
+    }
+    plan->wire_bytes = plan->native_bytes;
+  }
+}
+
+void transpose_mpi_execute(TransposeMPIPlan *plan, const void *src, void *dst) {
+  int N = plan->N;
+  size_t esz = dtype_size(plan->dt);
+  bool is_root = plan->rank == plan->root;
+  if (plan->win != MPI_WIN_NULL) {
+    execute_hierarchical(plan, (const char *) src, (char *) dst);
+    return;
+  }
+  if (plan->wire != 0) {
+    execute_wire(plan, (const char *) src, (char *) dst);
+    return;
+  }
+  // The datatypes of the full matrix only exist on the root, where they are significant
+  MPI_Datatype send_type = is_root ? plan->send_type : plan->elem_type;
+  MPI_Datatype recv_type = is_root ? plan->recv_type : plan->elem_type;
+  switch (plan->strategy) {
+    case TRANSPOSE_MPI_BROADCAST: {
+      char *mat = is_root ? (char *) src : plan->local;
+      bcast_large(mat, (size_t) N * N, plan->elem_type, plan->root, plan->comm);
+      // The transposition is done by the receive datatype
+      MPI_Gatherv(mat + (size_t) plan->first_row * N * esz, plan->local_rows, plan->row_type,
+                  dst, plan->count, plan->recv_disp, recv_type, plan->root, plan->comm);
+      // Conjugate the gathered matrix afterwards
+      if (is_root && plan->conj) {
+        conj_block(plan->dt, dst, N, N, N);
+      }
+      break;
+    }
+    case TRANSPOSE_MPI_SCATTER:
+      MPI_Scatterv(src, plan->count, plan->send_disp, send_type,
+                   plan->local, plan->local_rows, plan->row_type, plan->root, plan->comm);
+      // The transposition itself is done by the receive datatype, only the conjugation is local
+      if (plan->conj && plan->local_rows > 0) {
+        conj_block(plan->dt, plan->local, N, plan->local_rows, N);
+      }
+      MPI_Gatherv(plan->local, plan->local_rows, plan->row_type,
+                  dst, plan->count, plan->recv_disp, recv_type, plan->root, plan->comm);
+      break;
+    case TRANSPOSE_MPI_BLOCKS:
+      MPI_Scatterv(src, plan->count, plan->send_disp, send_type,
+                   plan->local, plan->local_rows, plan->row_type, plan->root, plan->comm);
+      transpose_execute(plan->local_plan, plan->local, plan->local_t);
+      MPI_Gatherv(plan->local_t, plan->local_rows, plan->row_type,
+                  dst, plan->count, plan->recv_disp, recv_type, plan->root, plan->comm);
+      break;
+  }
+  if (is_root) {
+    // Each rank but the root receives its piece (the whole matrix when broadcast) and sends it
+    // back transposed
+    size_t piece_bytes = ((size_t) N * N - piece_elems(rank_piece(plan, plan->root))) * esz;
+    plan->native_bytes = piece_bytes + (plan->strategy == TRANSPOSE_MPI_BROADCAST ? (size_t) (plan->size - 1) * N * N * esz : piece_bytes);
+    plan->wire_bytes = plan->native_bytes;
+  }
+}
+
+void transpose_mpi_wire_stats(const TransposeMPIPlan *plan, size_t *wire_bytes, size_t *native_bytes) {
+  *wire_bytes = plan->wire_bytes;
+  *native_bytes = plan->native_bytes;
+}
+
+const TransposeLayout *transpose_mpi_plan_layout(const TransposeMPIPlan *plan) {
+  return plan->layout;
+}
+
+void transpose_mpi_plan_destroy(TransposeMPIPlan *plan) {
+  if (plan == NULL) {
+    return;
+  }
+  if (plan->row_type != MPI_DATATYPE_NULL) {
+    MPI_Type_free(&plan->row_type);
+  }
+  if (plan->recv_type != MPI_DATATYPE_NULL && plan->recv_type != plan->send_type) {
+    MPI_Type_free(&plan->recv_type);
+  }
+  if (plan->send_type != MPI_DATATYPE_NULL) {
+    MPI_Type_free(&plan->send_type);
+  }
+  if (plan->recv_disp != plan->send_disp) {
+    free(plan->recv_disp);
+  }
+  free(plan->send_disp);
+  free(plan->count);
+  free(plan->local);
+  free(plan->local_t);
+  transpose_plan_destroy(plan->local_plan);
+  if (plan->wire_type != MPI_DATATYPE_NULL) {
+    MPI_Type_free(&plan->wire_type);
+  }
+  free(plan->wire_send);
+  free(plan->wire_recv);
+  free(plan->wire_send_bytes);
+  free(plan->wire_recv_bytes);
+  free(plan->wire_send_count);
+  free(plan->wire_send_disp);
+  free(plan->wire_recv_count);
+  free(plan->wire_recv_disp);
+  free(plan->wire_local);
+  free(plan->wire_local_t);
+  free(plan->shuffled);
+  free(plan->plain);
+  free(plan->plain_t);
+  transpose_plan_destroy(plan->wire_plan);
+  if (plan->win != MPI_WIN_NULL) {
+    MPI_Win_unlock_all(plan->win);
+    MPI_Win_free(&plan->win);
+  }
+  if (plan->leader_comm != MPI_COMM_NULL) {
+    MPI_Comm_free(&plan->leader_comm);
+  }
+  if (plan->node_comm != MPI_COMM_NULL) {
+    MPI_Comm_free(&plan->node_comm);
+  }
+  free(plan->node_count);
+  free(plan->node_disp);
+  free(plan->piece_disp);
+  free(plan->packed);
+  free(plan->gathered);
+  transpose_layout_destroy(plan->layout);
+  free(plan);
+}
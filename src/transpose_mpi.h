@@ -0,0 +1,71 @@
+#ifndef TRANSPOSE_MPI_H
+#define TRANSPOSE_MPI_H
+
+// Distributed plans of libtranspose. The N x N matrix lives on the root rank; creating the plan
+// commits the MPI datatypes, computes the displacements and allocates the per-rank buffers, so
+// that executing it only moves data.
+
+#include <mpi.h>
+#include "transpose.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  // Every rank receives the whole matrix and sends its band of rows as columns of the result
+  TRANSPOSE_MPI_BROADCAST,
+  // Bands of rows are scattered and gathered back as columns through the receive datatype
+  TRANSPOSE_MPI_SCATTER,
+  // Square blocks of a sqrt(P) x sqrt(P) grid are scattered, transposed locally and gathered
+  // at their mirrored position. Requires a square number of processes dividing N.
+  TRANSPOSE_MPI_BLOCKS,
+} TransposeMPIStrategy;
+
+// Wire formats of the blocks exchanged with the root, to pass in `flags`. Pieces are encoded
+// while being extracted from the matrix and decoded while being placed in the result.
+// Round to nearest bf16 or IEEE half: halves the traffic of float matrices, lossy.
+#define TRANSPOSE_WIRE_BF16 (1u << 8)
+#define TRANSPOSE_WIRE_HALF (1u << 9)
+// Split the elements into byte planes and compress them with zlib: exact, for any dtype.
+#define TRANSPOSE_WIRE_SHUFFLE (1u << 10)
+
+// Two-level collectives for ranks spread over several nodes: the root exchanges one message
+// per node with the first rank of the node, which shares the pieces of its node with the other
+// ranks through a shared-memory window. Not combined with the wire formats.
+#define TRANSPOSE_MPI_HIERARCHICAL (1u << 11)
+
+// TRANSPOSE_MPI_BLOCKS with the matrices stored by the root in the tiled layout returned by
+// transpose_mpi_plan_layout, whose tiles are the blocks: each block is sent and received as one
+// contiguous message instead of through a subarray datatype.
+#define TRANSPOSE_MPI_TILED (1u << 12)
+
+typedef struct TransposeMPIPlan TransposeMPIPlan;
+
+/// Plan the transpose of an N x N matrix held by `root` over the processes of `comm`. `tile` is
+/// the tile side of the local transpose of TRANSPOSE_MPI_BLOCKS, 0 lets the plan choose it;
+/// `flags` are the TRANSPOSE_* flags of transpose.h. Collective; returns NULL on every rank
+/// when the strategy cannot be used with this matrix and number of processes.
+TransposeMPIPlan *transpose_mpi_plan_create(MPI_Comm comm, int root, int N, DType dt,
+                                            TransposeMPIStrategy strategy, int tile, unsigned flags);
+
+/// Transpose `src` into `dst`. Both are only accessed on the root rank, the other ranks may
+/// pass NULL. Collective.
+void transpose_mpi_execute(TransposeMPIPlan *plan, const void *src, void *dst);
+
+/// Bytes sent between the root and the other ranks by the last execution, whole chunks of the
+/// wire formats included, and the bytes the native elements would take. Only meaningful on the
+/// root.
+void transpose_mpi_wire_stats(const TransposeMPIPlan *plan, size_t *wire_bytes, size_t *native_bytes);
+
+/// Tiled layout of the matrices of a TRANSPOSE_MPI_TILED plan on the root, NULL otherwise.
+const TransposeLayout *transpose_mpi_plan_layout(const TransposeMPIPlan *plan);
+
+/// Collective.
+void transpose_mpi_plan_destroy(TransposeMPIPlan *plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,7 +1,14 @@
+#include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "dtype.h"
+#include "sparse.h"
+
+/// Address of element (i, j) of a matrix of `esz`-byte elements stored as a table of row pointers.
+#define ELEM(mat, i, j, esz) ((mat)[i] + (size_t) (j) * (esz))
 
 typedef struct {
   double start;
@@ -12,13 +19,44 @@ double get_time(Timer timer) {
   return timer.end - timer.start;
 }
 
-/// Check if the transpose of the matrix is correct.
-bool check_correctness(int N, float **mat, float **mat_t) {
+/// Check if the transpose of the matrix is correct. When `conj` is set the transposed matrix
+/// must hold the complex conjugates of the input elements.
+bool check_correctness(int N, DType dt, bool conj, char **mat, char **mat_t) {
+  size_t esz = dtype_size(dt);
+  bool correct = true;
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      if (!dtype_equal(dt, ELEM(mat, i, j, esz), ELEM(mat_t, j, i, esz), conj)) {
+        printf("Error: mat[%d][%d] = ", i, j);
+        dtype_print(dt, ELEM(mat, i, j, esz));
+        printf(", mat_t[%d][%d] = ", j, i);
+        dtype_print(dt, ELEM(mat_t, j, i, esz));
+        printf("\n");
+        correct = false;
+      }
+    }
+  }
+  if (correct) {
+    printf("Matrix transpose is correct\n");
+  }
+  return correct;
+}
+
+/// Check the transpose of a float matrix sent through a lossy wire format: every element of
+/// mat_t must be the element of mat rounded to `wire` (bf16 or half).
+bool check_rounded_correctness(int N, DType wire, char **mat, char **mat_t) {
   bool correct = true;
   for (int i = 0; i < N; i++) {
     for (int j = 0; j < N; j++) {
-      if (mat[i][j] != mat_t[j][i]) {
-        printf("Error: mat[%d][%d] = %f, mat_t[%d][%d] = %f\n", i, j, mat[i][j], j, i, mat_t[j][i]);
+      float x = ((float *) mat[i])[j];
+      float got = ((float *) mat_t[j])[i];
+      double re, im;
+      // Large enough for any element type, as dtype_set and dtype_get switch on it
+      double rounded[2];
+      dtype_set(wire, rounded, x, 0);
+      dtype_get(wire, rounded, &re, &im);
+      if (got != (float) re && !(isnan(got) && isnan(x))) {
+        printf("Error: mat[%d][%d] = %.9g, mat_t[%d][%d] = %.9g, expected %.9g\n", i, j, x, j, i, got, re);
         correct = false;
       }
     }
@@ -29,51 +67,125 @@ bool check_correctness(int N, float **mat, float **mat_t) {
   return correct;
 }
 
+/// Largest absolute difference between the elements of a float matrix and its transpose.
+double max_transpose_error(int N, char **mat, char **mat_t) {
+  double max_error = 0;
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      double error = fabs((double) ((float *) mat_t[j])[i] - ((float *) mat[i])[j]);
+      max_error = error > max_error ? error : max_error;
+    }
+  }
+  return max_error;
+}
+
 /// Print the matrix.
-void print_matrix(int N, float **mat) {
-  for (int i = 0; i < N*N; i++) {
-    printf("%f ", *((*mat) + i));
+void print_matrix(int N, DType dt, char **mat) {
+  for (size_t i = 0; i < (size_t) N * N; i++) {
+    dtype_print(dt, *mat + i * dtype_size(dt));
     if ((i+1) % N == 0) printf("\n");
   }
   printf("\n");
 }
 
-/// Initialize a matrix of size n x m. The matrix is stored in a contiguous block of memory.
-void init_matrix(int N, int M, float*** mat) {
-  float* mem = (float*) malloc(N*M*sizeof(float));
-  *mat = (float**) malloc(N*sizeof(float*));
+/// Initialize a matrix of size n x m with elements of `esz` bytes. The matrix is stored in a
+/// contiguous block of memory. Sizes are computed in size_t so that matrices with more than 2^31
+/// elements can be allocated.
+void init_matrix(int N, int M, size_t esz, char*** mat) {
+  char* mem = (char*) malloc((size_t) N * M * esz);
+  *mat = (char**) malloc(N*sizeof(char*));
+  if (mem == NULL || *mat == NULL) {
+    fprintf(stderr, "Error: cannot allocate a %d x %d matrix\n", N, M);
+    exit(1);
+  }
   for (int i = 0; i < N; i++) {
-    (*mat)[i] = &(mem[i*M]);
+    (*mat)[i] = &(mem[(size_t) i * M * esz]);
   }
 }
 
 /// Initialize a random matrix of size n x n. The matrix is stored in a contiguous block of memory.
-void fill_rand_matrix(int N, float*** mat) {
+void fill_rand_matrix(int N, DType dt, char*** mat) {
   for (int i = 0; i < N; i++) {
     for (int j = 0; j < N; j++) {
-      (*mat)[i][j] = rand() / (float) RAND_MAX;
+      dtype_set_rand(dt, ELEM(*mat, i, j, dtype_size(dt)));
     }
   }
 }
 
 /// Initialize a random matrix of size n x n. The matrix is stored in a contiguous block of memory.
-void fill_sym_matrix(int N, float*** mat) {
+void fill_sym_matrix(int N, DType dt, char*** mat) {
+  size_t esz = dtype_size(dt);
   for (int i = 0; i < N; i++) {
     for (int j = 0; j <= i; j++) {
-      (*mat)[i][j] = rand() / (float) RAND_MAX;
-      (*mat)[j][i] = (*mat)[i][j];
+      dtype_set_rand(dt, ELEM(*mat, i, j, esz));
+      memcpy(ELEM(*mat, j, i, esz), ELEM(*mat, i, j, esz), esz);
+    }
+  }
+}
+
+/// Value stored at position (i, j) of generated matrices with `cols` columns. The value is
+/// exactly representable as a float, so file-backed outputs can be verified piece by piece
+/// without keeping the input in memory.
+float gen_value(int64_t i, int64_t j, int64_t cols) {
+  return (float) ((i * cols + j) % 16777213);
+}
+
+/// Store the generated value of position (i, j) in `elem`. Complex types get the value of the
+/// transposed position as imaginary part, so that conjugation and transposition are both visible.
+void set_gen_value(DType dt, void *elem, int64_t i, int64_t j, int64_t cols) {
+  dtype_set(dt, elem, gen_value(i, j, cols), gen_value(j, i, cols));
+}
+
+/// Remove the option `name` from the arguments. Returns its value, or the name itself for
+/// options without a value, and NULL if the option is not present. Both `--name value` and
+/// `--name=value` are accepted.
+const char *take_option(int *argc, char **argv, const char *name, bool has_value) {
+  size_t len = strlen(name);
+  for (int i = 1; i < *argc; i++) {
+    const char *value = NULL;
+    int used = 0;
+    if (strcmp(argv[i], name) == 0) {
+      if (has_value && i + 1 >= *argc) {
+        printf("Error: option %s requires a value\n", name);
+        exit(1);
+      }
+      value = has_value ? argv[i + 1] : argv[i];
+      used = has_value ? 2 : 1;
+    } else if (has_value && strncmp(argv[i], name, len) == 0 && argv[i][len] == '=') {
+      value = argv[i] + len + 1;
+      used = 1;
+    }
+    if (used > 0) {
+      for (int k = i; k + used <= *argc; k++) {
+        argv[k] = argv[k + used];
+      }
+      *argc -= used;
+      return value;
     }
   }
+  return NULL;
+}
+
+/// Parse the element type options shared by all implementations: `--dtype <type>` selects the
+/// element type (float by default) and `--conj` conjugates complex elements while transposing.
+void parse_dtype_args(int *argc, char **argv, DType *dt, bool *conj) {
+  const char *name = take_option(argc, argv, "--dtype", true);
+  *dt = name != NULL ? parse_dtype(name) : DTYPE_FLOAT;
+  *conj = take_option(argc, argv, "--conj", false) != NULL && dtype_info[*dt].complex;
 }
 
 void parse_args(int argc, char **argv, int *N, bool *check, bool *verbose) {
   if (argc < 2 || argc >= 5) {
-    printf("Usage: %s <matrix_dim> [<check_correctness>] [<verbose>]\n", argv[0]);
+    printf("Usage: %s <matrix_dim> [<check_correctness>] [<verbose>] [--dtype <type>] [--conj]\n", argv[0]);
     exit(1);
   } else {
     *check = false;
     *verbose = false;
     *N = atoi(argv[1]);
+    if (*N <= 0) {
+      printf("Error: matrix_dim must be a positive integer\n");
+      exit(1);
+    }
     if (argc >= 3 && strcmp(argv[2], "check") == 0) {
       *check = true;
     }
@@ -81,4 +193,74 @@ void parse_args(int argc, char **argv, int *N, bool *check, bool *verbose) {
       *verbose = true;
     }
   }
-}
\ No newline at end of file
+}
+
+/// Check that the sparse matrix `t` is the transpose of `a`: same number of elements, sorted
+/// rows, and every element (i, j) of `a` found at (j, i) in `t`, conjugated when `conj` is set.
+bool check_sparse_transpose(const SparseMatrix *a, const SparseMatrix *t, bool conj) {
+  size_t esz = dtype_size(a->dt);
+  if (t->rows != a->cols || t->cols != a->rows || t->nnz != a->nnz || t->row_ptr[t->rows] != t->nnz) {
+    printf("Error: transpose has shape %dx%d with %lld elements\n", t->rows, t->cols, (long long) t->nnz);
+    return false;
+  }
+  for (int i = 0; i < t->rows; i++) {
+    for (int64_t e = t->row_ptr[i] + 1; e < t->row_ptr[i + 1]; e++) {
+      if (t->col_idx[e] <= t->col_idx[e - 1]) {
+        printf("Error: row %d of the transpose is not sorted\n", i);
+        return false;
+      }
+    }
+  }
+  for (int i = 0; i < a->rows; i++) {
+    for (int64_t e = a->row_ptr[i]; e < a->row_ptr[i + 1]; e++) {
+      int j = a->col_idx[e];
+      int64_t lo = t->row_ptr[j], hi = t->row_ptr[j + 1];
+      while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (t->col_idx[mid] < i) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      if (lo == t->row_ptr[j + 1] || t->col_idx[lo] != i ||
+        !dtype_equal(a->dt, (const char *) a->values + e * esz, (const char *) t->values + lo * esz, conj)) {
+        printf("Error: element (%d, %d) is missing or wrong in the transpose\n", i, j);
+        return false;
+      }
+    }
+  }
+  printf("Matrix transpose is correct\n");
+  return true;
+}
+
+/// Print the elements of a sparse matrix, one per line.
+void print_sparse(const SparseMatrix *m) {
+  for (int i = 0; i < m->rows; i++) {
+    for (int64_t e = m->row_ptr[i]; e < m->row_ptr[i + 1]; e++) {
+      printf("(%d, %d) ", i, m->col_idx[e]);
+      dtype_print(m->dt, (const char *) m->values + e * dtype_size(m->dt));
+      printf("\n");
+    }
+  }
+}
+
+/// Parse the arguments of the sparse implementations: either `<rows> <cols> <density>` of a
+/// generated matrix or the path of a Matrix Market file, then the check and verbose flags.
+/// Returns whether the matrix is generated.
+bool parse_sparse_args(int argc, char **argv, bool *check, bool *verbose) {
+  bool generated = false;
+  if (argc >= 4) {
+    char *end;
+    strtol(argv[1], &end, 10);
+    generated = *end == '\0';
+  }
+  int first = generated ? 4 : 2;
+  if (argc < 2 || argc >= first + 3) {
+    printf("Usage: %s <rows> <cols> <density> | <file.mtx> [<check_correctness>] [<verbose>] [--dtype <type>] [--conj]\n", argv[0]);
+    exit(1);
+  }
+  *check = argc > first && strcmp(argv[first], "check") == 0;
+  *verbose = argc > first + 1 && strcmp(argv[first + 1], "verbose") == 0;
+  return generated;
+}